@@ -7,23 +7,36 @@
 #include <gtc/type_ptr.hpp>
 #include <gtc/matrix_transform.hpp>
 #include <gtc/quaternion.hpp>
+#include <gtc/packing.hpp>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <gtx/quaternion.hpp>
+#include <gtx/component_wise.hpp>
 
 #include <FreeImage.h>
 #include <freetype/ftstroke.h>
 #include <iostream>
 #include <iomanip>
+#include <array>
 #include <vector>
 #include <string>
 #include <regex>
 #include <map>
+#include <deque>
+#include <bitset>
 #include <unordered_map>
 #include <sstream>
 #include <fstream>
 #include <filesystem>
 #include <chrono>
+#include <charconv>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <numeric>
+#include <optional>
 
 #include "project_constants.h"
 
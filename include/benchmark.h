@@ -0,0 +1,60 @@
+#pragma once
+
+#include "base.h"
+
+// Plays a deterministic camera and light path, and keeps the results of each configuration to report and compare.
+class Benchmark final
+{
+public:
+   struct Keyframe
+   {
+      float Time;
+      glm::vec3 CameraPosition;
+      glm::vec3 CameraReference;
+      glm::vec3 CameraUp;
+      glm::vec4 LightPosition;
+   };
+
+   struct Result
+   {
+      std::string Variant;
+      int Width;
+      int Height;
+      int FrameNum;
+      double CPUMean;
+      double GPUMean;
+      double GPUP50;
+      double GPUP95;
+      double GPUP99;
+      double GPUMax;
+
+      Result() : Width( 0 ), Height( 0 ), FrameNum( 0 ), CPUMean( 0.0 ), GPUMean( 0.0 ), GPUP50( 0.0 ),
+      GPUP95( 0.0 ), GPUP99( 0.0 ), GPUMax( 0.0 ) {}
+   };
+
+   Benchmark() = default;
+   ~Benchmark() = default;
+
+   Benchmark(const Benchmark&) = delete;
+   Benchmark(const Benchmark&&) = delete;
+   Benchmark& operator=(const Benchmark&) = delete;
+   Benchmark& operator=(const Benchmark&&) = delete;
+
+   // The keyframes should be added in the order of time, and the time is normalized in [0, 1].
+   void addKeyframe(const Keyframe& keyframe) { Keyframes.emplace_back( keyframe ); }
+   [[nodiscard]] Keyframe getKeyframe(float time) const;
+   void addResult(const Result& result) { Results.emplace_back( result ); }
+   [[nodiscard]] const std::vector<Result>& getResults() const { return Results; }
+   [[nodiscard]] bool writeReport(const std::string& path) const;
+   [[nodiscard]] static bool readReport(std::vector<Result>& results, const std::string& path);
+   // A result regresses if its median GPU time is slower than the baseline by more than the threshold in percent.
+   // Returns the number of the regressions, and the results without a baseline are not counted.
+   // Returns -1 if the baseline cannot be read.
+   [[nodiscard]] int compareWithBaseline(const std::string& baseline_path, double threshold, std::ostream& stream) const;
+
+private:
+   std::vector<Keyframe> Keyframes;
+   std::vector<Result> Results;
+
+   static void splitCSVLine(std::vector<std::string>& fields, const std::string& line);
+};
\ No newline at end of file
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "base.h"
+#include "state_cache.h"
 
 class CameraGL final
 {
@@ -14,7 +14,7 @@ public:
       float near_plane = 1.0f,
       float far_plane = 5000.0f
    );
-   ~CameraGL() = default;
+   ~CameraGL();
 
    [[nodiscard]] bool getMovingState() const { return IsMoving; }
    [[nodiscard]] float getFOV() const { return FOV; }
@@ -27,7 +27,13 @@ public:
    [[nodiscard]] glm::vec3 getCameraPosition() const { return CamPos; }
    [[nodiscard]] const glm::mat4& getViewMatrix() const { return ViewMatrix; }
    [[nodiscard]] const glm::mat4& getProjectionMatrix() const { return ProjectionMatrix; }
+   // This is the product of the matrices uploaded by the latest bindUniformBuffer().
+   [[nodiscard]] const glm::mat4& getViewProjectionMatrix() const { return UploadedViewProjectionMatrix; }
+   // Uploads the view and projection matrices to the camera block only when they have changed since the last upload.
+   void bindUniformBuffer(GLuint binding) const;
    [[nodiscard]] float linearizeDepthValue(float depth) const;
+   // left, right, bottom, top, near and far planes in the world space, whose normals point inside
+   void getFrustumPlanes(std::array<glm::vec4, 6>& planes) const;
    void setMovingState(bool is_moving) { IsMoving = is_moving; }
    void pitch(int angle);
    void yaw(int angle);
@@ -70,6 +76,11 @@ private:
    glm::vec3 CamPos;
    glm::mat4 ViewMatrix;
    glm::mat4 ProjectionMatrix;
+   mutable GLuint UniformBuffer;
+   mutable bool IsUploaded;
+   mutable glm::mat4 UploadedViewMatrix;
+   mutable glm::mat4 UploadedProjectionMatrix;
+   mutable glm::mat4 UploadedViewProjectionMatrix;
 
    void updateCamera();
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "base.h"
+
+// Keeps the latest frame times in a ring buffer and summarizes them with percentiles.
+// A frame is submitted when its CPU work is done, and it is recorded once the GPU times of the same frame resolve,
+// so that every sample belongs to the frame and the variant it was measured with. The buffer is guarded by a mutex,
+// so a snapshot can be taken from another thread. It is not lock-free, because a reader without the lock could copy
+// a frame while the producer overwrites it with a newer one. The lock is taken about once per frame on the producer
+// side, and it is only contended while a snapshot is being copied.
+class FrameStatistics final
+{
+public:
+   inline static constexpr int MaxPassNum = 8;
+
+   struct Frame
+   {
+      int Variant;
+      double CPUFrameTime;
+      double SwapInterval;
+      std::array<double, MaxPassNum> PassTimes;
+      bool HasGPUTimes; // false if the GPU results of the frame were dropped
+
+      Frame() : Variant( 0 ), CPUFrameTime( 0.0 ), SwapInterval( 0.0 ), PassTimes(), HasGPUTimes( false ) {}
+   };
+
+   struct Summary
+   {
+      double Mean, P50, P95, P99, Max;
+
+      Summary() : Mean( 0.0 ), P50( 0.0 ), P95( 0.0 ), P99( 0.0 ), Max( 0.0 ) {}
+   };
+
+   FrameStatistics();
+   ~FrameStatistics() = default;
+
+   FrameStatistics(const FrameStatistics&) = delete;
+   FrameStatistics(const FrameStatistics&&) = delete;
+   FrameStatistics& operator=(const FrameStatistics&) = delete;
+   FrameStatistics& operator=(const FrameStatistics&&) = delete;
+
+   // The times of the GPU passes are recorded in the order of the names.
+   void initialize(int capacity, const std::vector<std::string>& pass_names);
+   void clear();
+   // A variant names the configuration that frames are rendered with, such as the shadow volume algorithm.
+   [[nodiscard]] int getVariantIndex(const std::string& name);
+   // Keeps the frame until the GPU times of the frame id are resolved.
+   void submit(uint64_t frame_id, const Frame& frame);
+   // Records the submitted frame of the id with the GPU times. The older submitted frames never get their GPU times,
+   // because the times resolve in order, so they are recorded without them.
+   void resolve(uint64_t frame_id, const std::vector<double>& pass_times);
+   // Records every submitted frame that is still waiting, without the GPU times.
+   void flushPending();
+   void getSnapshot(std::vector<Frame>& frames) const;
+   // The metrics are the CPU frame time, the swap interval, each pass time and the total GPU time, in this order.
+   [[nodiscard]] int getMetricNum() const { return static_cast<int>(PassNames.size()) + 3; }
+   [[nodiscard]] static bool isGPUMetric(int metric) { return metric >= 2; }
+   [[nodiscard]] std::string getMetricName(int metric) const;
+   [[nodiscard]] static double getMetric(const Frame& frame, int metric, int pass_num);
+   // Summarizes the metric over the frames of the variant, or over all of them if the variant is negative.
+   [[nodiscard]] Summary summarize(const std::vector<Frame>& frames, int metric, int variant = -1) const;
+   [[nodiscard]] bool writeCSV(const std::string& path) const;
+   [[nodiscard]] bool writeJSON(const std::string& path) const;
+   [[nodiscard]] uint64_t getRecordedNum() const;
+   [[nodiscard]] std::vector<std::string> getVariantNames() const;
+
+private:
+   mutable std::mutex Mutex;
+   uint64_t RecordedNum;
+   std::vector<Frame> Frames;
+   std::vector<std::string> PassNames;
+   std::vector<std::string> VariantNames;
+   std::deque<std::pair<uint64_t, Frame>> PendingFrames;
+
+   // The mutex has to be locked.
+   void record(const Frame& frame);
+};
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "base.h"
+
+// Measures the GPU time of render passes with timestamp queries.
+// The queries of a frame are read a few frames later, so that reading the results never waits for the GPU.
+// Each frame has an id, and its times are queued with the id once they resolve, so that they can be matched with
+// what was recorded for the frame on the CPU. A frame whose results are not ready in time is dropped and never queued.
+// A pass can be measured several times in a frame and the intervals are summed, but the same pass must not nest.
+class GPUProfilerGL final
+{
+public:
+   GPUProfilerGL();
+   ~GPUProfilerGL();
+
+   GPUProfilerGL(const GPUProfilerGL&) = delete;
+   GPUProfilerGL(const GPUProfilerGL&&) = delete;
+   GPUProfilerGL& operator=(const GPUProfilerGL&) = delete;
+   GPUProfilerGL& operator=(const GPUProfilerGL&&) = delete;
+
+   void initialize(const std::vector<std::string>& pass_names);
+   void release();
+   // Collects the results of the frame issued FrameBufferNum - 1 frames ago, and then starts a new frame.
+   void beginFrame();
+   // Waits for the GPU and collects every frame that has not been collected yet.
+   void flush();
+   // Pops the oldest resolved frame. Only the latest MaxResolvedFrameNum frames are kept if nobody pops them.
+   [[nodiscard]] bool popResolvedFrame(uint64_t& frame_id, std::vector<double>& pass_times);
+   // the id of the frame started by the latest beginFrame(), which begins from 1
+   [[nodiscard]] uint64_t getFrameId() const { return FrameId; }
+   void begin(int pass);
+   void end(int pass);
+   // Writes the average of each pass over the frames collected since the last log, and starts a new average.
+   void log(std::ostream& stream);
+   [[nodiscard]] int getPassNum() const { return static_cast<int>(PassNames.size()); }
+   [[nodiscard]] const std::string& getPassName(int pass) const { return PassNames[pass]; }
+   // These are in milliseconds of the latest collected frame.
+   [[nodiscard]] double getPassTime(int pass) const { return PassTimes[pass]; }
+   [[nodiscard]] const std::vector<double>& getPassTimes() const { return PassTimes; }
+   [[nodiscard]] double getFrameTime() const
+   {
+      return std::accumulate( PassTimes.begin(), PassTimes.end(), 0.0 );
+   }
+   [[nodiscard]] int getAveragedFrameNum() const { return AveragedFrameNum; }
+
+private:
+   inline static constexpr int FrameBufferNum = 3;
+   inline static constexpr size_t MaxResolvedFrameNum = 64;
+
+   struct Interval
+   {
+      int Pass;
+      GLuint BeginQuery;
+      GLuint EndQuery;
+   };
+
+   struct FrameQueries
+   {
+      int IntervalNum;
+      uint64_t FrameId; // 0 if there is nothing to collect
+      std::vector<Interval> Intervals;
+
+      FrameQueries() : IntervalNum( 0 ), FrameId( 0 ) {}
+   };
+
+   int FrameIndex;
+   uint64_t FrameId;
+   int AveragedFrameNum;
+   std::vector<std::string> PassNames;
+   std::vector<int> OpenIntervals;
+   std::vector<double> PassTimes;
+   std::vector<double> PassTimeSums;
+   std::array<FrameQueries, FrameBufferNum> Frames;
+   std::deque<std::pair<uint64_t, std::vector<double>>> ResolvedFrames;
+
+   void collect(FrameQueries& frame);
+};
\ No newline at end of file
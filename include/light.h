@@ -1,12 +1,12 @@
 #pragma once
 
-#include "shader.h"
+#include "state_cache.h"
 
 class LightGL final
 {
 public:
    LightGL();
-   ~LightGL() = default;
+   ~LightGL();
 
    [[nodiscard]] bool isLightOn() const;
    void toggleLightSwitch();
@@ -18,15 +18,56 @@ public:
       const glm::vec3& spotlight_direction = glm::vec3(0.0f, 0.0f, -1.0f),
       float spotlight_cutoff_angle_in_degree = 180.0f,
       float spotlight_feather = 0.0f,
-      float falloff_radius = 1000.0f
+      float falloff_radius = 1000.0f,
+      bool is_bounded = true // whether the additive pass of the light is bounded by its falloff sphere
    );
    void activateLight(const int& light_index);
    void deactivateLight(const int& light_index);
-   void transferUniformsToShader(const ShaderGL* shader);
+   // Uploads the light block only when a light has changed since the last upload.
+   void bindUniformBuffer(GLuint binding);
    [[nodiscard]] int getTotalLightNum() const { return TotalLightNum; }
    [[nodiscard]] glm::vec4 getLightPosition(int light_index) { return Positions[light_index]; }
+   void setLightPosition(const glm::vec4& light_position, int light_index)
+   {
+      Positions[light_index] = light_position;
+      IsDirty = true;
+   }
+   [[nodiscard]] float getFallOffRadius(int light_index) const { return FallOffRadii[light_index]; }
+   [[nodiscard]] bool isBounded(int light_index) const { return IsBounded[light_index]; }
+   [[nodiscard]] bool isLightActivated(int light_index) const { return IsActivated[light_index]; }
 
 private:
+   inline static constexpr int MaxLightNum = 32; // MAX_LIGHTS of the scene shader
+
+   // std140 LightInfo of the scene shader
+   struct LightBlockElement
+   {
+      GLint LightSwitch;
+      GLint Padding0[3];
+      glm::vec4 Position;
+      glm::vec4 AmbientColor;
+      glm::vec4 DiffuseColor;
+      glm::vec4 SpecularColor;
+      glm::vec3 SpotlightDirection;
+      float SpotlightCutoffAngle;
+      float SpotlightFeather;
+      float FallOffRadius;
+      GLint IsBounded;
+      float Padding1;
+   };
+   static_assert( sizeof( LightBlockElement ) == 112 );
+
+   // std140 block { LightInfo Lights[MAX_LIGHTS]; int UseLight; int LightNum; vec4 GlobalAmbient; }
+   struct LightBlock
+   {
+      std::array<LightBlockElement, MaxLightNum> Lights;
+      GLint UseLight;
+      GLint LightNum;
+      GLint Padding[2];
+      glm::vec4 GlobalAmbient;
+   };
+
+   bool IsDirty;
    bool TurnLightOn;
    int TotalLightNum;
    glm::vec4 GlobalAmbientColor;
@@ -39,4 +80,6 @@ private:
    std::vector<float> SpotlightCutoffAngles;
    std::vector<float> SpotlightFeathers;
    std::vector<float> FallOffRadii;
+   std::vector<bool> IsBounded;
+   GLuint UniformBuffer;
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "base.h"
+#include "thread_pool.h"
+
+class MeshOptimizer final
+{
+public:
+   inline static constexpr int DefaultCacheSize = 16;
+
+   // The index buffer is a list of primitives of primitive_size indices each,
+   // which is 3 for GL_TRIANGLES and 6 for GL_TRIANGLES_ADJACENCY.
+   // Every vertex a primitive references goes through the vertex shader, so all of them are taken into account.
+
+   // Reorders whole primitives for the post-transform vertex cache with Tipsify [Sander et al. 2007].
+   static void reorderPrimitives(
+      std::vector<GLuint>& indices,
+      size_t vertex_num,
+      int primitive_size,
+      int cache_size = DefaultCacheSize
+   );
+   // Renumbers vertices in the order they are first referenced for the vertex fetch locality.
+   // remap[old index] is the new index.
+   static void reorderVertices(std::vector<GLuint>& remap, std::vector<GLuint>& indices, size_t vertex_num);
+   // The average number of vertex shader invocations per primitive with a FIFO cache of cache_size entries
+   [[nodiscard]] static float getACMR(
+      const std::vector<GLuint>& indices,
+      int primitive_size,
+      int cache_size = DefaultCacheSize
+   );
+
+   // Replaces every index with the first referenced vertex at exactly the same position,
+   // so that faces sharing a position also share an index.
+   static void weldVertices(
+      std::vector<GLuint>& welded_indices,
+      const std::vector<glm::vec3>& vertices,
+      const std::vector<GLuint>& indices,
+      ThreadPool& pool
+   );
+   // Welds the vertices within epsilon of each other using a uniform grid, and returns the number of welded vertices.
+   // In the order of the first reference, a vertex is welded to the earliest vertex in its reach which is kept.
+   static size_t weldVerticesWithTolerance(
+      std::vector<GLuint>& welded_indices,
+      const std::vector<glm::vec3>& vertices,
+      const std::vector<GLuint>& indices,
+      float epsilon,
+      ThreadPool& pool
+   );
+   // Builds the GL_TRIANGLES_ADJACENCY index buffer of welded triangles.
+   // The adjacent face of an edge is the other one between the first and the last face sharing it,
+   // and the vertex of an open edge is repeated instead.
+   static void getTrianglesAdjacency(
+      std::vector<GLuint>& adjacency_indices,
+      const std::vector<GLuint>& triangle_indices,
+      size_t vertex_num,
+      ThreadPool& pool
+   );
+
+   // The number of edges without an adjacent face in a GL_TRIANGLES_ADJACENCY index buffer
+   [[nodiscard]] static size_t getOpenEdgeNum(const std::vector<GLuint>& adjacency_indices);
+
+   template<typename T>
+   static void remapVertices(std::vector<T>& attributes, const std::vector<GLuint>& remap)
+   {
+      std::vector<T> remapped(attributes.size());
+      for (size_t i = 0; i < attributes.size(); ++i) remapped[remap[i]] = attributes[i];
+      attributes = std::move( remapped );
+   }
+
+private:
+   inline static constexpr GLuint NoIndex = std::numeric_limits<GLuint>::max();
+   inline static constexpr size_t MinTaskSize = 1 << 16;
+
+   struct SortKey
+   {
+      uint64_t Key;
+      GLuint Value;
+   };
+
+   [[nodiscard]] static int getTaskNum(size_t size, const ThreadPool& pool)
+   {
+      return static_cast<int>(std::clamp<size_t>( size / MinTaskSize, 1, pool.getThreadNum() ));
+   }
+   [[nodiscard]] static size_t getTaskBegin(size_t size, int task, int task_num)
+   {
+      return size * task / task_num;
+   }
+   [[nodiscard]] static uint64_t getPositionHash(const glm::vec3& position);
+   [[nodiscard]] static glm::i64vec3 getCell(const glm::vec3& position, float cell_size);
+   [[nodiscard]] static uint64_t getCellHash(const glm::i64vec3& cell);
+   static void getFirstUses(
+      std::vector<GLuint>& first_uses,
+      std::vector<GLuint>& used_vertices,
+      const std::vector<GLuint>& indices,
+      size_t vertex_num
+   );
+   static void remapIndices(
+      std::vector<GLuint>& remapped_indices,
+      const std::vector<GLuint>& indices,
+      const std::vector<GLuint>& remap,
+      ThreadPool& pool
+   );
+   static void sortKeys(std::vector<SortKey>& keys, int key_bits, ThreadPool& pool);
+   [[nodiscard]] static int getNextVertex(
+      const std::vector<int>& live_primitive_nums,
+      const std::vector<int>& cache_time_stamps,
+      const std::vector<GLuint>& candidates,
+      std::vector<GLuint>& dead_ends,
+      int& cursor,
+      int time_stamp,
+      int cache_size
+   );
+};
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "thread_pool.h"
+
+class ObjParser final
+{
+public:
+   struct ObjData
+   {
+      bool HasRelativeIndices;
+      bool IsChunk;
+      // How far the positive indices of a chunk reach beyond the elements read so far in the chunk
+      int VertexOverrun, NormalOverrun, TextureOverrun;
+      std::vector<glm::vec3> Vertices;
+      std::vector<glm::vec3> Normals;
+      std::vector<glm::vec2> Textures;
+      std::vector<GLuint> VertexIndices;
+      std::vector<GLuint> NormalIndices;
+      std::vector<GLuint> TextureIndices;
+
+      ObjData() :
+         HasRelativeIndices( false ), IsChunk( false ), VertexOverrun( 0 ), NormalOverrun( 0 ), TextureOverrun( 0 ) {}
+   };
+
+   // Parses the 'v', 'vt', 'vn' and 'f' statements of [begin, end); anything else is skipped.
+   // Faces with more than three corners are triangulated as a fan, and a corner whose index refers to an element
+   // that is not read yet is dropped.
+   static void parse(ObjData& data, const char* begin, const char* end);
+
+   // Splits [begin, end) into chunks at line boundaries, parses them on the pool and concatenates the results,
+   // so the output is identical to parse().
+   static void parseInParallel(ObjData& data, const char* begin, const char* end, ThreadPool& pool);
+
+private:
+   inline static constexpr size_t MinChunkSize = 1 << 20;
+
+   struct FaceVertex
+   {
+      int Vertex, Texture, Normal;
+
+      FaceVertex() : Vertex( -1 ), Texture( -1 ), Normal( -1 ) {}
+   };
+
+   [[nodiscard]] static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+   [[nodiscard]] static const char* skipSpaces(const char* ptr, const char* end)
+   {
+      while (ptr < end && isSpace( *ptr )) ++ptr;
+      return ptr;
+   }
+   [[nodiscard]] static const char* skipLine(const char* ptr, const char* end)
+   {
+      const auto* new_line = static_cast<const char*>(std::memchr( ptr, '\n', end - ptr ));
+      return new_line == nullptr ? end : new_line + 1;
+   }
+   [[nodiscard]] static const char* parseFloat(float& value, const char* ptr, const char* end);
+   [[nodiscard]] static const char* parseIndex(
+      int& index,
+      int& overrun,
+      ObjData& data,
+      int element_num,
+      const char* ptr,
+      const char* end
+   );
+   [[nodiscard]] static const char* parseFaceVertex(
+      FaceVertex& face_vertex,
+      ObjData& data,
+      const char* ptr,
+      const char* end
+   );
+   static void addFaceVertex(ObjData& data, const FaceVertex& face_vertex);
+   template<typename T>
+   static void concatenate(
+      std::vector<T>& merged,
+      const std::vector<ObjData>& chunks,
+      std::vector<T> ObjData::* member,
+      ThreadPool& pool
+   )
+   {
+      // The prefix sum of the chunk sizes is where each chunk starts in the merged array.
+      std::vector<size_t> offsets(chunks.size() + 1, 0);
+      for (size_t i = 0; i < chunks.size(); ++i) offsets[i + 1] = offsets[i] + (chunks[i].*member).size();
+
+      merged.resize( offsets.back() );
+      pool.run(
+         static_cast<int>(chunks.size()), [&](int i) {
+            const std::vector<T>& source = chunks[i].*member;
+            if (!source.empty()) std::memcpy( merged.data() + offsets[i], source.data(), sizeof( T ) * source.size() );
+         }
+      );
+   }
+};
\ No newline at end of file
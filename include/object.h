@@ -1,6 +1,9 @@
 #pragma once
 
 #include "shader.h"
+#include "obj_parser.h"
+#include "mapped_file.h"
+#include "mesh_optimizer.h"
 
 class ObjectGL final
 {
@@ -10,6 +13,14 @@ public:
    ObjectGL();
    ~ObjectGL();
 
+   void setParallelLoading(bool parallel_loading);
+   void setMeshCacheUsage(bool use_mesh_cache);
+   void setMeshOptimization(bool optimize_mesh);
+   void setCompactVertexFormat(bool use_compact_vertex_format);
+   void setPositionStream(bool use_position_stream);
+   void setWeldingEpsilon(float welding_epsilon);
+   // Each instance is transformed by its own transform after the world matrix of the draw.
+   void setInstanceTransforms(const std::vector<glm::mat4>& transforms);
    void setEmissionColor(const glm::vec4& emission_color);
    void setAmbientReflectionColor(const glm::vec4& ambient_reflection_color);
    void setDiffuseReflectionColor(const glm::vec4& diffuse_reflection_color);
@@ -21,6 +32,12 @@ public:
       const std::vector<glm::vec3>& vertices,
       const std::vector<glm::vec3>& normals
    );
+   void setObject(
+      GLenum draw_mode,
+      const std::vector<glm::vec3>& vertices,
+      const std::vector<glm::vec3>& normals,
+      const std::vector<GLuint>& indices
+   );
    void setObject(
       GLenum draw_mode,
       const std::vector<glm::vec3>& vertices,
@@ -67,13 +84,33 @@ public:
    void replaceVertices(const std::vector<glm::vec3>& vertices, bool normals_exist, bool textures_exist);
    void replaceVertices(const std::vector<float>& vertices, bool normals_exist, bool textures_exist);
    [[nodiscard]] bool isAdjacencyMode() const { return AdjacencyMode; }
+   [[nodiscard]] bool isIndexed() const { return IBO != 0; }
+   [[nodiscard]] bool isCompactVertexFormat() const { return UseCompactVertexFormat; }
    [[nodiscard]] GLuint getVAO() const { return VAO; }
    [[nodiscard]] GLuint getIBO() const { return IBO; }
+   [[nodiscard]] GLuint getPositionVAO() const { return PositionVAO != 0 ? PositionVAO : VAO; }
+   [[nodiscard]] GLuint getPositionBuffer() const { return PositionVBO != 0 ? PositionVBO : VBO; }
+   [[nodiscard]] GLsizei getPositionStride() const { return PositionStride; }
    [[nodiscard]] GLenum getDrawMode() const { return DrawMode; }
    [[nodiscard]] GLsizei getVertexNum() const { return VerticesCount; }
    [[nodiscard]] GLsizei getIndexNum() const { return static_cast<GLsizei>(IndexBuffer.size()); }
    [[nodiscard]] GLuint getTextureID(int index) const { return TextureID[index]; }
    [[nodiscard]] int getTextureNum() const { return static_cast<int>(TextureID.size()); }
+   [[nodiscard]] const glm::vec3& getBoundingBoxMin() const { return BoundingBoxMin; }
+   [[nodiscard]] const glm::vec3& getBoundingBoxMax() const { return BoundingBoxMax; }
+   [[nodiscard]] const glm::mat4& getDequantizationMatrix() const { return DequantizationMatrix; }
+   [[nodiscard]] const std::vector<GLuint>& getIndexBuffer() const { return IndexBuffer; }
+   [[nodiscard]] GLuint getInstanceBuffer() const { return InstanceBuffer; }
+   [[nodiscard]] GLsizei getInstanceNum() const { return static_cast<GLsizei>(InstanceTransforms.size()); }
+   [[nodiscard]] uint64_t getInstanceVersion() const { return InstanceVersion; }
+   [[nodiscard]] const std::vector<glm::mat4>& getInstanceTransforms() const { return InstanceTransforms; }
+   // The positions of the vertex buffer, dequantized if the compact vertex format is used
+   void getPositions(std::vector<glm::vec3>& positions) const;
+   [[nodiscard]] GLuint getCustomBufferID(const std::string& name) const
+   {
+      const auto it = CustomBuffers.find( name );
+      return it == CustomBuffers.end() ? 0 : it->second;
+   }
 
    template<typename T>
    void addShaderStorageBufferObject(const std::string& name, GLuint binding_index, int data_size)
@@ -110,29 +147,82 @@ public:
    }
 
 private:
-   struct VectorComparison
+   enum MeshCacheFlag : uint32_t {
+      MeshCacheNormalsExist = 1u << 0u,
+      MeshCacheTexturesExist = 1u << 1u,
+      MeshCacheAdjacencyMode = 1u << 2u,
+      MeshCacheOptimized = 1u << 3u,
+      MeshCacheCompactVertex = 1u << 4u, // the format of the stored vertices
+      MeshCacheCompactVertexRequested = 1u << 5u // the format asked for, which can fall back to the float format
+   };
+
+   // The .svmesh file is this header followed by DataBuffer and then IndexBuffer.
+   struct MeshCacheHeader
+   {
+      char Magic[8];
+      uint32_t Version;
+      uint32_t Flags;
+      uint32_t VertexNum;
+      uint32_t VertexStride;
+      uint64_t FloatNum;
+      uint64_t IndexNum;
+      float BoundingBoxMin[3];
+      float BoundingBoxMax[3];
+      float WeldingEpsilon;
+      uint32_t Reserved;
+   };
+   static_assert( sizeof( MeshCacheHeader ) == 72 );
+
+   inline static constexpr char MeshCacheMagic[8] = "SVMESH";
+   inline static constexpr uint32_t MeshCacheVersion = 4;
+
+   struct VertexKey
+   {
+      GLuint Vertex, Normal, Texture;
+
+      [[nodiscard]] bool operator==(const VertexKey& other) const
+      {
+         return Vertex == other.Vertex && Normal == other.Normal && Texture == other.Texture;
+      }
+   };
+
+   struct VertexKeyHash
    {
-      [[nodiscard]] bool operator()(const glm::vec3& a, const glm::vec3& b) const
+      [[nodiscard]] size_t operator()(const VertexKey& key) const
       {
-         if (a.x < b.x) return true;
-         else if (a.x == b.x) {
-            if (a.y < b.y) return true;
-            else if (a.y == b.y) if (a.z < b.z) return true;
-         }
-         return false;
+         uint64_t hash = (static_cast<uint64_t>(key.Vertex) << 32u) | key.Normal;
+         hash ^= static_cast<uint64_t>(key.Texture) * 0x9E3779B97F4A7C15ull;
+         hash ^= hash >> 29u;
+         return static_cast<size_t>(hash * 0xBF58476D1CE4E5B9ull);
       }
    };
 
    bool AdjacencyMode;
+   bool ParallelLoading;
+   bool UseMeshCache;
+   bool OptimizeMesh;
+   bool CompactVertexRequested; // applies only to the vertices loaded from an OBJ file
+   bool UseCompactVertexFormat; // the format of the current vertex buffer, which can fall back to the float format
+   bool UsePositionStream;
+   float WeldingEpsilon;
    GLuint VAO;
    GLuint VBO;
    GLuint IBO;
+   GLuint PositionVAO; // reads only the tightly packed positions of PositionVBO
+   GLuint PositionVBO;
+   GLsizei PositionStride; // in bytes, of the buffer getPositionBuffer() returns
+   GLuint InstanceBuffer; // the shader storage buffer of InstanceTransforms
+   uint64_t InstanceVersion; // increases whenever InstanceTransforms changes
    GLenum DrawMode;
    GLsizei VerticesCount;
+   glm::vec3 BoundingBoxMin;
+   glm::vec3 BoundingBoxMax;
+   glm::mat4 DequantizationMatrix; // maps the quantized positions of the compact vertex format to the object space
    std::vector<GLuint> TextureID;
    std::vector<GLfloat> DataBuffer;
    std::vector<GLuint> IndexBuffer;
    std::map<std::string, GLuint> CustomBuffers;
+   std::vector<glm::mat4> InstanceTransforms;
    glm::vec4 EmissionColor;
    glm::vec4 AmbientReflectionColor; // It is usually set to the same color with DiffuseReflectionColor.
                                      // Otherwise, it should be in balance with DiffuseReflectionColor.
@@ -143,8 +233,11 @@ private:
    [[nodiscard]] bool prepareTexture2DUsingFreeImage(const std::string& file_path, bool is_grayscale) const;
    void prepareNormal() const;
    void prepareTexture(bool normals_exist) const;
-   void prepareVertexBuffer(int n_bytes_per_vertex);
+   void prepareVertexBuffer(int n_bytes_per_vertex, bool compact_vertex = false);
+   void prepareVertexBuffer(int n_bytes_per_vertex, const GLvoid* data, GLsizeiptr size, bool compact_vertex);
+   void preparePositionBuffer(int n_bytes_per_vertex, const GLvoid* data, GLsizeiptr size);
    void prepareIndexBuffer();
+   void prepareIndexBuffer(const GLvoid* data, GLsizeiptr size);
    static void getSquareObject(
       std::vector<glm::vec3>& vertices,
       std::vector<glm::vec3>& normals,
@@ -155,11 +248,43 @@ private:
       const std::vector<glm::vec3>& vertices,
       const std::vector<GLuint>& vertex_indices
    );
+   void findBoundingBox(const std::vector<glm::vec3>& vertices);
    void findAdjacency(const std::vector<glm::vec3>& vertices, const std::vector<GLuint>& indices);
+   void optimizeMesh(
+      std::vector<glm::vec3>& vertices,
+      std::vector<glm::vec3>& normals,
+      std::vector<glm::vec2>& textures
+   );
    [[nodiscard]] bool readObjectFile(
       std::vector<glm::vec3>& vertices,
       std::vector<glm::vec3>& normals,
       std::vector<glm::vec2>& textures,
       const std::string& file_path
    );
+   [[nodiscard]] static glm::mat4 getDequantizationMatrix(
+      const glm::vec3& bounding_box_min,
+      const glm::vec3& bounding_box_max
+   );
+   [[nodiscard]] static glm::vec2 encodeOctahedron(const glm::vec3& normal);
+   [[nodiscard]] static glm::vec3 decodeOctahedron(const glm::vec2& encoded);
+   [[nodiscard]] bool prepareCompactDataBuffer(
+      int& n_bytes_per_vertex,
+      const std::vector<glm::vec3>& vertices,
+      const std::vector<glm::vec3>& normals,
+      const std::vector<glm::vec2>& textures
+   );
+   [[nodiscard]] static std::filesystem::path getMeshCachePath(const std::string& obj_file_path);
+   [[nodiscard]] bool readMeshCache(
+      bool& normals_exist,
+      bool& textures_exist,
+      const std::filesystem::path& cache_path,
+      const std::string& obj_file_path
+   );
+   void writeMeshCache(
+      const std::filesystem::path& cache_path,
+      bool normals_exist,
+      bool textures_exist,
+      int n_bytes_per_vertex
+   ) const;
+   [[nodiscard]] bool prepareObjectFile(bool& normals_exist, bool& textures_exist, const std::string& obj_file_path);
 };
\ No newline at end of file
@@ -12,11 +12,27 @@
 #include "base.h"
 #include "text.h"
 #include "light.h"
+#include "shadow_volume_generator.h"
+#include "shadow_volume_cache.h"
+#include "static_batch.h"
+#include "shadow_mask.h"
+#include "gpu_profiler.h"
+#include "frame_statistics.h"
+#include "benchmark.h"
+#include "state_cache.h"
+
+// EXT_depth_bounds_test is not a part of the core profile, so it is loaded separately if the driver supports it.
+#ifndef GL_DEPTH_BOUNDS_TEST_EXT
+#define GL_DEPTH_BOUNDS_TEST_EXT 0x8890
+#endif
+typedef void (APIENTRYP PFNGLDEPTHBOUNDSEXTPROC)(GLclampd zmin, GLclampd zmax);
 
 class RendererGL final
 {
 public:
    RendererGL();
+   // Renders the given number of frames into an offscreen framebuffer without any window, and play() returns after that.
+   explicit RendererGL(int headless_frame_num);
    ~RendererGL() = default;
 
    RendererGL(const RendererGL&) = delete;
@@ -24,32 +40,89 @@ public:
    RendererGL& operator=(const RendererGL&) = delete;
    RendererGL& operator=(const RendererGL&&) = delete;
 
+   // This is false if the context could not be created, and then nothing can be rendered.
+   [[nodiscard]] bool isInitialized() const { return Initialized; }
+   // Either GL_DEPTH24_STENCIL8 or GL_DEPTH32F_STENCIL8, which the shadow mask also uses for its copy of the depth.
+   // The window only has the former, so this returns false for the latter unless the renderer is headless.
+   [[nodiscard]] bool setDepthStencilFormat(GLenum format);
    void play();
+   // Sweeps the algorithms and the robustness at a few resolutions along a fixed camera and light path in the headless
+   // mode, and writes the report. The number of frames per configuration is the one given to the constructor.
+   // Returns false if the report could not be written or if a configuration regressed beyond the baseline.
+   [[nodiscard]] bool benchmark(const std::string& baseline_path, double regression_threshold);
 
 private:
-   enum class ALGORITHM_TO_COMPARE { Z_FAIL = 0, Z_PASS };
+   enum class ALGORITHM_TO_COMPARE { Z_FAIL = 0, Z_PASS, AUTOMATIC };
+   enum class SHADOW_VOLUME_BACKEND { GEOMETRY_SHADER = 0, COMPUTE_SHADER, CPU };
+   enum class RENDER_PASS { DEPTH_PREPASS = 0, SHADOW_VOLUME, SHADING, TEXT };
 
    inline static RendererGL* Renderer = nullptr;
    GLFWwindow* Window;
+   // EGLDisplay and EGLContext of the headless mode, which are kept opaque so that this header does not need EGL.
+   void* HeadlessDisplay;
+   void* HeadlessContext;
+   bool Headless;
+   bool Initialized;
    bool Pause;
    bool Robust;
+   bool UseShadowVolumeCache;
+   bool UseMultipleLights;
+   bool UseFiniteExtrusion;
+   bool UseInstancing;
    int FrameWidth;
    int FrameHeight;
    int ActiveLightIndex;
+   int HeadlessFrameNum;
    glm::ivec2 ClickedPoint;
    std::unique_ptr<TextGL> Texter;
    std::unique_ptr<CameraGL> MainCamera;
    std::unique_ptr<CameraGL> TextCamera;
+   std::unique_ptr<CameraGL> CaptureCamera;
    std::unique_ptr<ShaderGL> TextShader;
    std::unique_ptr<ShaderGL> ShadowVolumeShader;
+   std::unique_ptr<ShaderGL> ShadowVolumeCaptureShader;
    std::unique_ptr<ShaderGL> SceneShader;
-   std::unique_ptr<ObjectGL> WallObject;
+   std::unique_ptr<ShaderGL> DepthShader;
+   std::unique_ptr<ShaderGL> SilhouetteShader;
+   std::unique_ptr<ShaderGL> ShadowVolumeIndirectShader;
+   std::unique_ptr<ShaderGL> ShadowVolumeCPUShader;
+   std::unique_ptr<ShaderGL> ShadowMaskShader;
+   std::unique_ptr<StaticBatchGL> StaticBatch;
    std::unique_ptr<ObjectGL> LucyObject;
    std::unique_ptr<LightGL> Lights;
+   std::unique_ptr<ShadowVolumeGenerator> VolumeGenerator;
+   std::vector<std::unique_ptr<ShadowVolumeCacheGL>> VolumeCaches;
+   std::unique_ptr<ShadowMaskGL> ShadowMask;
+   std::unique_ptr<GPUProfilerGL> Profiler;
+   std::unique_ptr<FrameStatistics> Statistics;
    ALGORITHM_TO_COMPARE AlgorithmToCompare;
+   SHADOW_VOLUME_BACKEND ShadowVolumeBackend;
+   glm::mat4 LucyWorldMatrix;
+   GLuint ShadowVolumeVAO;
+   GLuint SilhouetteBuffer;
+   GLuint ShadowVolumeCommandBuffer;
+   GLuint CPUVolumeVAO;
+   GLuint CPUVolumeBuffer;
+   PFNGLDEPTHBOUNDSEXTPROC DepthBounds;
+   // The framebuffer that the frame is rendered to, which is the window or an offscreen one in the headless mode.
+   GLuint MainFramebuffer;
+   GLuint MainColorBuffer;
+   GLuint MainDepthStencilBuffer;
+   GLenum MainDrawBuffer;
+   GLenum MainDepthStencilFormat;
 
    void registerCallbacks() const;
-   void initialize();
+   void prepareScene();
+   void releaseScene();
+   void resizeFrame(int width, int height);
+   void setBenchmarkPath(Benchmark& benchmark) const;
+   [[nodiscard]] bool initialize();
+   [[nodiscard]] bool createHeadlessContext();
+   void destroyHeadlessContext();
+   void prepareMainFramebuffer();
+   void releaseMainFramebuffer();
+   [[nodiscard]] void* getProcAddress(const char* name) const;
+   [[nodiscard]] static bool isExtensionSupported(const std::string& name);
    void writeFrame(const std::string& name) const;
    void writeDepthTexture(const std::string& name) const;
    void writeStencilTexture(const std::string& name) const;
@@ -65,14 +138,67 @@ private:
    void setLights() const;
    void setWallObject() const;
    void setLucyObject() const;
+   void setLucyInstances() const;
+   void getLucyWorldMatrices(std::vector<glm::mat4>& world_matrices) const;
+   void prepareSilhouetteBuffers();
+   void releaseSilhouetteBuffers();
    static void getBoundingBox(std::array<glm::vec3, 8>& bounding_box, const std::array<glm::vec3, 8>& points);
+   static void getWorldBoundingBox(
+      std::array<glm::vec3, 8>& bounding_box,
+      const ObjectGL* object,
+      const glm::mat4& to_world
+   );
+   [[nodiscard]] bool isShadowVolumeVisible(const ObjectGL* caster, const glm::mat4& to_world, int light_index) const;
+   [[nodiscard]] bool isInOcclusionPyramid(const ObjectGL* caster, const glm::mat4& to_world, int light_index) const;
+   [[nodiscard]] float getExtrusionRadius(int light_index) const;
+   [[nodiscard]] bool getLightBounds(glm::ivec4& scissor, glm::vec2& depth_bounds, int light_index) const;
 
-   void drawBoxObject(ShaderGL* shader, const CameraGL* camera) const;
-   void drawLucyObject(ShaderGL* shader, const CameraGL* camera) const;
+   void drawBoxObject(ShaderGL* shader, const CameraGL* camera, bool use_position_stream = false) const;
+   void drawLucyObject(ShaderGL* shader, const CameraGL* camera, bool use_position_stream = false) const;
+   // Transfers the uniforms and binds the vertex array of Lucy, and returns the number of the instances to draw.
+   int prepareLucyObject(ShaderGL* shader, const CameraGL* camera, bool use_position_stream) const;
+   void drawLucyInstances(int first_instance, int instance_num) const;
    void drawDepthMap() const;
-   void drawShadowVolumeWithZFail(bool robust) const;
-   void drawShadowVolumeWithZPass(bool robust) const;
-   void drawShadow() const;
+   void drawGeneratedLucyShadowVolume(
+      bool is_z_fail_algorithm,
+      bool robust,
+      int light_index,
+      const glm::mat4& to_world
+   ) const;
+   void drawIndirectLucyShadowVolume(
+      bool is_z_fail_algorithm,
+      bool robust,
+      int light_index,
+      const glm::mat4& to_world
+   ) const;
+   // Returns false if nothing is drawn because the volume is neither cached nor stable enough to be captured.
+   [[nodiscard]] bool drawCachedLucyShadowVolume(
+      bool is_z_fail_algorithm,
+      bool robust,
+      int light_index,
+      const std::vector<int>& visible_instances
+   ) const;
+   // Draws the volumes of the given instances, which have to be visible.
+   void drawLucyShadowVolume(
+      bool is_z_fail_algorithm,
+      bool robust,
+      int light_index,
+      const std::vector<int>& instances
+   ) const;
+   void drawShadowVolumeWithZFail(bool robust, int light_index, const std::vector<int>& instances) const;
+   void drawShadowVolumeWithZPass(bool robust, int light_index, const std::vector<int>& instances) const;
+   void drawCasterShadowVolumes(int light_index, int& z_pass_caster_num, int& z_fail_caster_num) const;
+   // Draws the volumes of the casters in the shadow volume pass of the profiler.
+   void drawShadowVolume(int light_index, int& z_pass_caster_num, int& z_fail_caster_num) const;
+   void drawShadow(int light_index, int lighting_pass) const;
+   void drawShadowWithMultipleLights(int& z_pass_caster_num, int& z_fail_caster_num) const;
+   void drawShadowWithMask(int& z_pass_caster_num, int& z_fail_caster_num) const;
    void drawText(const std::string& text, glm::vec2 start_position) const;
    void render() const;
+   [[nodiscard]] std::string getVariantName() const;
+   // The frame is submitted with the profiler frame id, and it is recorded when its GPU pass times resolve.
+   void recordFrame(double cpu_frame_time, double swap_interval) const;
+   // If it waits, the GPU finishes and every submitted frame is recorded.
+   void resolveGPUTimes(bool wait) const;
+   void writeFrameStatistics() const;
 };
\ No newline at end of file
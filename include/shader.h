@@ -1,35 +1,30 @@
 ﻿#pragma once
 
 #include "base.h"
-#include "camera.h"
+#include "transform_buffer.h"
 
 class ShaderGL final
 {
 public:
-   struct LightLocationSet
-   {
-      GLint LightSwitch, LightPosition;
-      GLint LightAmbient, LightDiffuse, LightSpecular, LightFallOffRadius;
-      GLint SpotlightDirection, SpotlightCutoffAngle, SpotlightFeather;
-
-      LightLocationSet() : LightSwitch( 0 ), LightPosition( 0 ), LightAmbient( 0 ), LightDiffuse( 0 ),
-      LightSpecular( 0 ), LightFallOffRadius( 0 ), SpotlightDirection( 0 ), SpotlightCutoffAngle( 0 ),
-      SpotlightFeather( 0 ) {}
-   };
-
    struct LocationSet
    {
       GLint World, View, Projection, ModelViewProjection;
+      GLint TransformBlock; // the block index, or -1 if the program still uses the plain matrix uniforms
+      GLint Dequantization, UseCompactVertex, UseInstancing, UseDrawData;
       GLint MaterialEmission, MaterialAmbient, MaterialDiffuse, MaterialSpecular, MaterialSpecularExponent;
       std::map<GLint, GLint> Texture; // <binding point, texture id>
-      GLint UseLight, LightNum, GlobalAmbient;
-      std::vector<LightLocationSet> Lights;
 
-      LocationSet() : World( 0 ), View( 0 ), Projection( 0 ), ModelViewProjection( 0 ), MaterialEmission( 0 ),
-      MaterialAmbient( 0 ), MaterialDiffuse( 0 ), MaterialSpecular( 0 ), MaterialSpecularExponent( 0 ), UseLight( 0 ),
-      LightNum( 0 ), GlobalAmbient( 0 ) {}
+      LocationSet() : World( 0 ), View( 0 ), Projection( 0 ), ModelViewProjection( 0 ), TransformBlock( -1 ),
+      Dequantization( 0 ), UseCompactVertex( -1 ), UseInstancing( -1 ), UseDrawData( -1 ),
+      MaterialEmission( 0 ), MaterialAmbient( 0 ), MaterialDiffuse( 0 ), MaterialSpecular( 0 ),
+      MaterialSpecularExponent( 0 ) {}
    };
 
+   // the binding points of the uniform blocks shared by the programs
+   inline static constexpr GLuint CameraBlockBinding = 0;
+   inline static constexpr GLuint TransformBlockBinding = 1;
+   inline static constexpr GLuint LightBlockBinding = 2;
+
    ShaderGL();
    virtual ~ShaderGL();
 
@@ -41,9 +36,15 @@ public:
       const char* tessellation_evaluation_shader_path = nullptr
    );
    void setComputeShaders(const char* compute_shader_path);
+   // Relinks the program so that the given outputs are captured in a single interleaved buffer.
+   void setTransformFeedbackVaryings(const std::vector<const char*>& varyings) const;
    void setTextUniformLocations();
    void setShadowVolumeUniformLocations();
-   void setSceneUniformLocations(int light_num);
+   void setDepthUniformLocations();
+   void setSilhouetteUniformLocations();
+   void setShadowVolumeIndirectUniformLocations();
+   void setShadowVolumeCPUUniformLocations();
+   void setSceneUniformLocations();
    void addUniformLocation(const std::string& name)
    {
       CustomLocations[name] = glGetUniformLocation( ShaderProgram, name.c_str() );
@@ -87,50 +88,15 @@ public:
    }
    [[nodiscard]] GLuint getShaderProgram() const { return ShaderProgram; }
    [[nodiscard]] GLint getLocation(const std::string& name) const { return CustomLocations.find( name )->second; }
+   [[nodiscard]] GLint getDequantizationLocation() const { return Location.Dequantization; }
+   [[nodiscard]] GLint getCompactVertexLocation() const { return Location.UseCompactVertex; }
+   [[nodiscard]] GLint getInstancingLocation() const { return Location.UseInstancing; }
+   [[nodiscard]] GLint getDrawDataLocation() const { return Location.UseDrawData; }
    [[nodiscard]] GLint getMaterialEmissionLocation() const { return Location.MaterialEmission; }
    [[nodiscard]] GLint getMaterialAmbientLocation() const { return Location.MaterialAmbient; }
    [[nodiscard]] GLint getMaterialDiffuseLocation() const { return Location.MaterialDiffuse; }
    [[nodiscard]] GLint getMaterialSpecularLocation() const { return Location.MaterialSpecular; }
    [[nodiscard]] GLint getMaterialSpecularExponentLocation() const { return Location.MaterialSpecularExponent; }
-   [[nodiscard]] GLint getLightAvailabilityLocation() const { return Location.UseLight; }
-   [[nodiscard]] GLint getLightNumLocation() const { return Location.LightNum; }
-   [[nodiscard]] GLint getGlobalAmbientLocation() const { return Location.GlobalAmbient; }
-   [[nodiscard]] GLint getLightSwitchLocation(int light_index) const
-   {
-      return Location.Lights[light_index].LightSwitch;
-   }
-   [[nodiscard]] GLint getLightPositionLocation(int light_index) const
-   {
-      return Location.Lights[light_index].LightPosition;
-   }
-   [[nodiscard]] GLint getLightAmbientLocation(int light_index) const
-   {
-      return Location.Lights[light_index].LightAmbient;
-   }
-   [[nodiscard]] GLint getLightDiffuseLocation(int light_index) const
-   {
-      return Location.Lights[light_index].LightDiffuse;
-   }
-   [[nodiscard]] GLint getLightSpecularLocation(int light_index) const
-   {
-      return Location.Lights[light_index].LightSpecular;
-   }
-   [[nodiscard]] GLint getLightSpotlightDirectionLocation(int light_index) const
-   {
-      return Location.Lights[light_index].SpotlightDirection;
-   }
-   [[nodiscard]] GLint getLightSpotlightCutoffAngleLocation(int light_index) const
-   {
-      return Location.Lights[light_index].SpotlightCutoffAngle;
-   }
-   [[nodiscard]] GLint getLightSpotlightFeatherLocation(int light_index) const
-   {
-      return Location.Lights[light_index].SpotlightFeather;
-   }
-   [[nodiscard]] GLint getLightFallOffRadiusLocation(int light_index) const
-   {
-      return Location.Lights[light_index].LightFallOffRadius;
-   }
 
 protected:
    GLuint ShaderProgram;
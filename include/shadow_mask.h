@@ -0,0 +1,61 @@
+#pragma once
+
+#include "shader.h"
+#include "state_cache.h"
+
+// Rasterizes the shadow volumes into a reduced-resolution depth-stencil target,
+// and resolves the stencil into a mask texture that the scene shader upsamples with the depth of the full resolution.
+class ShadowMaskGL final
+{
+public:
+   enum class VOLUME_PASS { FULL_RESOLUTION = 0, REDUCED_RESOLUTION };
+
+   ShadowMaskGL();
+   ~ShadowMaskGL();
+
+   ShadowMaskGL(const ShadowMaskGL&) = delete;
+   ShadowMaskGL(const ShadowMaskGL&&) = delete;
+   ShadowMaskGL& operator=(const ShadowMaskGL&) = delete;
+   ShadowMaskGL& operator=(const ShadowMaskGL&&) = delete;
+
+   // The scale is the ratio of the frame size to the mask size, and 1 releases the targets.
+   // The main framebuffer is the one whose depth is copied, and it is bound back after the resolve.
+   // The depth is copied with a blit, so the format must be the depth-stencil format of the main framebuffer.
+   void initialize(int frame_width, int frame_height, int scale, GLuint main_framebuffer, GLenum depth_stencil_format);
+   void release();
+   // Copies the depth of the main framebuffer and binds the reduced target for the stencil volume pass.
+   void beginVolumePass() const;
+   // Writes 1 to the mask where the stencil is nonzero, and binds the main framebuffer back.
+   void resolve(const ShaderGL* resolve_shader) const;
+   // The mask is bound to the unit 1 and its depth to the unit 2.
+   void bindTextures() const;
+   // The volume pass timings are double-buffered, so the result of a query is read two passes later without stalling.
+   void beginTiming(VOLUME_PASS pass);
+   void endTiming(VOLUME_PASS pass);
+   void nextFrame() { FrameNum++; }
+   // The full-resolution pass is only measured now and then for the comparison.
+   [[nodiscard]] bool isReferenceFrame() const { return FrameNum % 64 == 0; }
+   [[nodiscard]] bool isEnabled() const { return Scale > 1; }
+   [[nodiscard]] int getScale() const { return Scale; }
+   [[nodiscard]] double getVolumePassTime(VOLUME_PASS pass) const
+   {
+      return VolumePassTimes[static_cast<int>(pass)];
+   }
+
+private:
+   int Scale;
+   int FrameWidth;
+   int FrameHeight;
+   int MaskWidth;
+   int MaskHeight;
+   uint64_t FrameNum;
+   GLuint MainFramebuffer;
+   GLuint FBO;
+   GLuint MaskTexture;
+   GLuint DepthStencilTexture;
+   GLuint EmptyVAO;
+   std::array<std::array<GLuint, 2>, 2> TimerQueries;
+   std::array<std::array<bool, 2>, 2> IsQueryIssued;
+   std::array<int, 2> QueryIndices;
+   std::array<double, 2> VolumePassTimes;
+};
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "base.h"
+#include "state_cache.h"
+
+// Keeps the world-space shadow volume of a caster captured with transform feedback,
+// so that it is replayed with a plain draw while the caster transform, the light and the algorithm stay the same.
+// A capture waits for its overflow query, so it is taken only after the key has stayed the same for a few lookups.
+// Each instance is captured into its own range, so that the replay can skip the instances that are not visible.
+class ShadowVolumeCacheGL final
+{
+public:
+   struct Key
+   {
+      glm::mat4 WorldMatrix;
+      glm::vec4 LightPosition;
+      float ExtrusionRadius;
+      int InstanceNum;
+      uint64_t InstanceVersion; // of the instance transforms, which the volume was captured with
+      bool IsZFailAlgorithm;
+      bool Robust;
+
+      [[nodiscard]] bool operator==(const Key& other) const
+      {
+         return WorldMatrix == other.WorldMatrix && LightPosition == other.LightPosition &&
+            ExtrusionRadius == other.ExtrusionRadius && InstanceNum == other.InstanceNum &&
+            InstanceVersion == other.InstanceVersion && IsZFailAlgorithm == other.IsZFailAlgorithm &&
+            Robust == other.Robust;
+      }
+   };
+
+   ShadowVolumeCacheGL();
+   ~ShadowVolumeCacheGL();
+
+   ShadowVolumeCacheGL(const ShadowVolumeCacheGL&) = delete;
+   ShadowVolumeCacheGL(const ShadowVolumeCacheGL&&) = delete;
+   ShadowVolumeCacheGL& operator=(const ShadowVolumeCacheGL&) = delete;
+   ShadowVolumeCacheGL& operator=(const ShadowVolumeCacheGL&&) = delete;
+
+   // The capacity is in triangles, and it grows whenever a capture overflows.
+   void initialize(GLsizeiptr triangle_capacity);
+   void release();
+   // Counts a lookup and returns whether the captured volume is still valid for the key.
+   [[nodiscard]] bool lookUp(const Key& key);
+   // Whether the missed key has stayed the same long enough to be captured
+   [[nodiscard]] bool isKeyStable() const { return StableLookUpNum >= MinStableLookUpNum; }
+   void invalidate() { IsValid = false; }
+   // Everything drawn between these is captured instead of rasterized, and each instance is drawn between
+   // beginInstance() and endInstance() in order.
+   // endCapture() returns false if the buffer overflowed, and then the draw has to be captured again.
+   void beginCapture(int instance_num);
+   void beginInstance(int instance) const;
+   void endInstance() const;
+   [[nodiscard]] bool endCapture(const Key& key);
+   // The vertex shader of the draw receives the homogeneous world-space positions at location 0.
+   void draw(const std::vector<int>& instances) const;
+   // The lookups are counted over the latest ones, so that the rate follows the current behavior.
+   [[nodiscard]] int getRecentLookUpNum() const { return RecentLookUpNum; }
+   [[nodiscard]] int getRecentHitNum() const { return static_cast<int>(RecentHits.count()); }
+
+private:
+   inline static constexpr int MinStableLookUpNum = 8;
+   inline static constexpr int RecentLookUpCapacity = 64;
+
+   bool IsValid;
+   Key CachedKey;
+   Key MissedKey;
+   int StableLookUpNum;
+   GLuint TransformFeedback;
+   GLuint VolumeBuffer;
+   GLuint VAO;
+   GLuint OverflowQuery;
+   GLsizeiptr TriangleCapacity;
+   int RecentLookUpNum;
+   std::bitset<RecentLookUpCapacity> RecentHits;
+   std::vector<GLuint> InstanceQueries; // the primitives written for each instance
+   std::vector<GLint> InstanceFirsts;
+   std::vector<GLsizei> InstanceCounts;
+
+   void prepareVolumeBuffer();
+};
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "thread_pool.h"
+
+// Builds the same shadow volume triangles as shadow_volume.geom on the CPU.
+// Everything is in the object space, so the face planes are computed once and each frame only classifies them.
+class ShadowVolumeGenerator final
+{
+public:
+   ShadowVolumeGenerator();
+   ~ShadowVolumeGenerator() = default;
+
+   ShadowVolumeGenerator(const ShadowVolumeGenerator&) = delete;
+   ShadowVolumeGenerator(const ShadowVolumeGenerator&&) = delete;
+   ShadowVolumeGenerator& operator=(const ShadowVolumeGenerator&) = delete;
+   ShadowVolumeGenerator& operator=(const ShadowVolumeGenerator&&) = delete;
+
+   // The indices are of GL_TRIANGLES_ADJACENCY, and the positions are used in order if there are no indices.
+   void setMesh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& adjacency_indices, ThreadPool& pool);
+   // eye_scale is the uniform scale of the model-view matrix, which converts the eye-space epsilons of the shader.
+   // A positive extrusion_radius bounds the volume by the sphere around a point light, in the object space.
+   void generate(
+      const glm::vec4& light_position,
+      float eye_scale,
+      float extrusion_radius,
+      bool is_z_fail_algorithm,
+      bool robust,
+      ThreadPool& pool
+   );
+   // a triangle list of homogeneous object-space positions, whose w is 0 at infinity unless the volume is bounded
+   [[nodiscard]] const std::vector<glm::vec4>& getVolumeVertices() const { return VolumeVertices; }
+   [[nodiscard]] size_t getTriangleNum() const { return TriangleNum; }
+   [[nodiscard]] double getTrianglesPerSecondPerCore() const
+   {
+      return ElapsedSeconds > 0.0 ? static_cast<double>(TriangleNum) / (ElapsedSeconds * CoreNum) : 0.0;
+   }
+
+private:
+   inline static constexpr size_t MinTaskSize = 1 << 14;
+   inline static constexpr float Epsilon = 1e-1f;
+
+   bool UseAVX2;
+   size_t TriangleNum;
+   size_t PlaneNum; // per plane set, padded to a multiple of 8
+   int CoreNum;
+   double ElapsedSeconds;
+   std::vector<glm::vec3> Positions;
+   std::vector<GLuint> Indices;
+
+   // Set 0 is the planes of the triangles, and set j + 1 is the planes of the adjacent triangles across edge j.
+   // They are the structure of arrays, so that 8 planes are classified at once.
+   std::vector<float> PlaneX;
+   std::vector<float> PlaneY;
+   std::vector<float> PlaneZ;
+   // the smallest and largest dot( n, p ) over the three vertices p of the plane
+   std::vector<float> PlaneDMin;
+   std::vector<float> PlaneDMax;
+   std::vector<uint8_t> FacingBits;
+   std::vector<glm::vec4> VolumeVertices;
+
+   [[nodiscard]] int getTaskNum(size_t size, const ThreadPool& pool) const
+   {
+      return static_cast<int>(std::clamp<size_t>( size / MinTaskSize, 1, pool.getThreadNum() ));
+   }
+   [[nodiscard]] const glm::vec3& getPosition(size_t triangle, int corner) const
+   {
+      return Positions[Indices.empty() ? triangle * 6 + corner : Indices[triangle * 6 + corner]];
+   }
+   [[nodiscard]] bool isFacing(int set, size_t triangle) const
+   {
+      const size_t plane = set * PlaneNum + triangle;
+      return (FacingBits[plane >> 3] >> (plane & 7)) & 1;
+   }
+   // This is true only if the CPU running the program supports AVX2 and FMA.
+   [[nodiscard]] static bool isAVX2Supported();
+   void classifyPlanes(size_t begin, size_t end, const glm::vec4& light_position, float threshold);
+#ifdef USE_AVX2
+   void classifyPlanesAVX2(
+      size_t begin,
+      size_t end,
+      const std::vector<float>& plane_d,
+      const glm::vec4& light_position,
+      float threshold
+   );
+#endif
+   [[nodiscard]] int getVertexNum(size_t triangle, bool is_z_fail_algorithm, bool is_finite, bool robust) const;
+   void writeVolume(
+      glm::vec4* output,
+      size_t triangle,
+      const glm::vec4& light_position,
+      float offset,
+      float extrusion_radius,
+      bool is_z_fail_algorithm,
+      bool robust
+   ) const;
+};
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "base.h"
+
+// Shadows the OpenGL states that the render passes change, and drops the calls that would not change them.
+// Every change of these states has to go through this. After a direct change or after deleting a bound object,
+// invalidate() has to be called, so that the next calls are issued again.
+class StateCacheGL final
+{
+public:
+   StateCacheGL();
+   ~StateCacheGL() = default;
+
+   StateCacheGL(const StateCacheGL&) = delete;
+   StateCacheGL(const StateCacheGL&&) = delete;
+   StateCacheGL& operator=(const StateCacheGL&) = delete;
+   StateCacheGL& operator=(const StateCacheGL&&) = delete;
+
+   [[nodiscard]] static StateCacheGL& getInstance()
+   {
+      static StateCacheGL cache;
+      return cache;
+   }
+   void invalidate();
+   // Keeps the counts of the previous frame and starts counting again.
+   void beginFrame();
+   void enable(GLenum capability) { setCapability( capability, true ); }
+   void disable(GLenum capability) { setCapability( capability, false ); }
+   void setCapability(GLenum capability, bool enabled);
+   void depthMask(GLboolean flag);
+   void depthFunc(GLenum func);
+   void stencilFunc(GLenum func, GLint reference, GLuint mask);
+   void stencilOpSeparate(GLenum face, GLenum stencil_fail, GLenum depth_fail, GLenum depth_pass);
+   void blendFunc(GLenum source_factor, GLenum destination_factor);
+   void useProgram(GLuint program);
+   void bindVertexArray(GLuint vertex_array);
+   void bindDrawIndirectBuffer(GLuint buffer);
+   void bindUniformBuffer(GLuint binding, GLuint buffer) { bindUniformBufferRange( binding, buffer, 0, 0 ); }
+   // The zero size binds the whole buffer.
+   void bindUniformBufferRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size);
+   // This binds both the draw and read framebuffers, but only the draw one is shadowed,
+   // because the read framebuffer is bound directly right before reading pixels.
+   void bindFramebuffer(GLuint framebuffer);
+   // The draw buffer belongs to the currently bound framebuffer.
+   void drawBuffer(GLenum buffer);
+   void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+   void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+   [[nodiscard]] uint64_t getIssuedCallNum() const { return LastIssuedCallNum; }
+   [[nodiscard]] uint64_t getDroppedCallNum() const { return LastDroppedCallNum; }
+
+private:
+   struct StencilOperation
+   {
+      GLenum StencilFail, DepthFail, DepthPass;
+
+      [[nodiscard]] bool operator==(const StencilOperation& other) const
+      {
+         return StencilFail == other.StencilFail && DepthFail == other.DepthFail && DepthPass == other.DepthPass;
+      }
+   };
+
+   uint64_t IssuedCallNum;
+   uint64_t DroppedCallNum;
+   uint64_t LastIssuedCallNum;
+   uint64_t LastDroppedCallNum;
+   std::unordered_map<GLenum, bool> Capabilities;
+   std::unordered_map<GLuint, GLenum> DrawBuffers;
+   std::unordered_map<GLuint, std::tuple<GLuint, GLintptr, GLsizeiptr>> UniformBuffers;
+   std::optional<GLboolean> DepthMask;
+   std::optional<GLenum> DepthFunc;
+   std::optional<std::tuple<GLenum, GLint, GLuint>> StencilFunc;
+   std::array<std::optional<StencilOperation>, 2> StencilOperations; // front, back
+   std::optional<std::pair<GLenum, GLenum>> BlendFunc;
+   std::optional<GLuint> Program;
+   std::optional<GLuint> VertexArray;
+   std::optional<GLuint> DrawIndirectBuffer;
+   std::optional<GLuint> Framebuffer;
+   std::optional<glm::ivec4> Viewport;
+   std::optional<glm::ivec4> Scissor;
+
+   // Returns true if the call has to be issued, and counts it either way.
+   template<typename T>
+   [[nodiscard]] bool update(std::optional<T>& cached, const T& value)
+   {
+      if (cached.has_value() && cached.value() == value) {
+         DroppedCallNum++;
+         return false;
+      }
+      cached = value;
+      IssuedCallNum++;
+      return true;
+   }
+};
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "object.h"
+#include "state_cache.h"
+
+// Keeps static meshes in one vertex and index buffer, and draws all of them with a single multi-draw-indirect call.
+// The transform and material of each draw are fetched from a shader storage buffer with gl_DrawID.
+class StaticBatchGL final
+{
+public:
+   struct Material
+   {
+      glm::vec4 EmissionColor;
+      glm::vec4 AmbientReflectionColor;
+      glm::vec4 DiffuseReflectionColor;
+      glm::vec4 SpecularReflectionColor;
+      float SpecularReflectionExponent;
+
+      Material() :
+         EmissionColor( 0.0f, 0.0f, 0.0f, 1.0f ), AmbientReflectionColor( 0.2f, 0.2f, 0.2f, 1.0f ),
+         DiffuseReflectionColor( 0.8f, 0.8f, 0.8f, 1.0f ), SpecularReflectionColor( 0.0f, 0.0f, 0.0f, 1.0f ),
+         SpecularReflectionExponent( 0.0f ) {}
+   };
+
+   StaticBatchGL();
+   ~StaticBatchGL();
+
+   StaticBatchGL(const StaticBatchGL&) = delete;
+   StaticBatchGL(const StaticBatchGL&&) = delete;
+   StaticBatchGL& operator=(const StaticBatchGL&) = delete;
+   StaticBatchGL& operator=(const StaticBatchGL&&) = delete;
+
+   // Returns the index of the mesh, which can be drawn many times with addDraw().
+   int addMesh(
+      const std::vector<glm::vec3>& vertices,
+      const std::vector<glm::vec3>& normals,
+      const std::vector<GLuint>& indices
+   );
+   void addDraw(int mesh_index, const glm::mat4& to_world, const Material& material);
+   // Uploads the meshes and draws added so far, which are not changed afterwards.
+   void build();
+   void transferUniformsToShader(const ShaderGL* shader) const;
+   void draw(bool position_only = false) const;
+   [[nodiscard]] int getDrawNum() const { return static_cast<int>(Commands.size()); }
+
+private:
+   inline static constexpr GLuint DrawDataBinding = 5;
+
+   struct MeshRange
+   {
+      GLuint IndexNum;
+      GLuint FirstIndex;
+      GLint BaseVertex;
+   };
+
+   struct DrawElementsIndirectCommand
+   {
+      GLuint Count;
+      GLuint InstanceCount;
+      GLuint FirstIndex;
+      GLint BaseVertex;
+      GLuint BaseInstance;
+   };
+
+   // the std430 layout of DrawData in the shaders
+   struct DrawData
+   {
+      glm::mat4 WorldMatrix;
+      glm::vec4 EmissionColor;
+      glm::vec4 AmbientColor;
+      glm::vec4 DiffuseColor;
+      glm::vec4 SpecularColor;
+      float SpecularExponent;
+      float Padding[3];
+   };
+   static_assert( sizeof( DrawData ) == 144, "DrawData must match its std430 layout." );
+
+   GLuint VAO;
+   GLuint PositionVAO;
+   GLuint VBO;
+   GLuint IBO;
+   GLuint CommandBuffer;
+   GLuint DrawDataBuffer;
+   std::vector<GLfloat> DataBuffer; // interleaved positions and normals
+   std::vector<GLuint> IndexBuffer;
+   std::vector<MeshRange> Meshes;
+   std::vector<DrawElementsIndirectCommand> Commands;
+   std::vector<DrawData> Draws;
+
+   void release();
+};
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "base.h"
+
+class ThreadPool final
+{
+public:
+   explicit ThreadPool(int thread_num = 0);
+   ~ThreadPool();
+
+   ThreadPool(const ThreadPool&) = delete;
+   ThreadPool(const ThreadPool&&) = delete;
+   ThreadPool& operator=(const ThreadPool&) = delete;
+   ThreadPool& operator=(const ThreadPool&&) = delete;
+
+   [[nodiscard]] static ThreadPool& getInstance()
+   {
+      static ThreadPool pool;
+      return pool;
+   }
+   [[nodiscard]] int getThreadNum() const { return static_cast<int>(Workers.size()) + 1; }
+
+   // Calls task( i ) for every i in [0, task_num) and returns when all of them are finished.
+   // The calling thread also executes tasks, so this must not be called from inside a task.
+   void run(int task_num, const std::function<void(int)>& task);
+
+private:
+   bool Stop;
+   int TaskNum;
+   int NextTask;
+   int RemainingTasks;
+   uint64_t Generation;
+   const std::function<void(int)>* Task;
+   std::vector<std::thread> Workers;
+   std::mutex Mutex;
+   std::mutex RunMutex;
+   std::condition_variable WakeUp;
+   std::condition_variable Done;
+
+   void work();
+   void executeTasks(uint64_t generation);
+};
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "camera.h"
+
+// Streams the per-draw transforms of the transform block into a persistently mapped uniform buffer.
+// The buffer is split into a region for each frame in flight, and a region is written again only after the GPU
+// has passed the fence of the frame that used it. A draw with the same transform as the previous one reuses its slot.
+class TransformBufferGL final
+{
+public:
+   TransformBufferGL();
+   ~TransformBufferGL() = default;
+
+   TransformBufferGL(const TransformBufferGL&) = delete;
+   TransformBufferGL(const TransformBufferGL&&) = delete;
+   TransformBufferGL& operator=(const TransformBufferGL&) = delete;
+   TransformBufferGL& operator=(const TransformBufferGL&&) = delete;
+
+   [[nodiscard]] static TransformBufferGL& getInstance()
+   {
+      static TransformBufferGL buffer;
+      return buffer;
+   }
+   void release();
+   // Waits until the region of this frame is no longer read by the GPU.
+   void beginFrame();
+   void endFrame();
+   // The camera block of the camera has to be bound before this, because its view-projection matrix is used.
+   void bind(GLuint binding, const glm::mat4& to_world, const CameraGL* camera);
+   [[nodiscard]] int getWrittenSlotNum() const { return LastWrittenSlotNum; }
+
+private:
+   // std140 block { mat4 WorldMatrix; mat4 ModelViewProjectionMatrix; }
+   struct Transform
+   {
+      glm::mat4 WorldMatrix;
+      glm::mat4 ModelViewProjectionMatrix;
+   };
+
+   inline static constexpr int RegionNum = 3;
+   inline static constexpr int SlotNumPerRegion = 4096;
+
+   int Region;
+   int SlotIndex;
+   int LastWrittenSlotNum;
+   GLuint Buffer;
+   GLintptr SlotSize;
+   uint8_t* MappedBuffer;
+   std::array<GLsync, RegionNum> Fences;
+   std::optional<GLintptr> LastOffset;
+   glm::mat4 LastWorldMatrix;
+   glm::mat4 LastViewProjectionMatrix;
+
+   void initialize();
+};
\ No newline at end of file
@@ -1,8 +1,31 @@
 #include "renderer.h"
 
-int main()
+int main(int argc, char* argv[])
 {
+   // Any headless mode takes --depth32f at the end to render with the 32-bit float depth instead of the 24-bit one.
+   const bool use_float_depth = argc >= 2 && std::string(argv[argc - 1]) == "--depth32f";
+   if (use_float_depth) argc--;
+   const GLenum depth_stencil_format = use_float_depth ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+
+   // ShadowVolume --headless <frame number> renders the frames offscreen and writes the last one without any window.
+   if (argc == 3 && std::string(argv[1]) == "--headless") {
+      RendererGL renderer( std::max( std::atoi( argv[2] ), 1 ) );
+      if (!renderer.isInitialized() || !renderer.setDepthStencilFormat( depth_stencil_format )) return 1;
+      renderer.play();
+      return 0;
+   }
+
+   // ShadowVolume --benchmark <frame number> [baseline report] [threshold in percent] runs the benchmark matrix.
+   if (argc >= 3 && std::string(argv[1]) == "--benchmark") {
+      RendererGL renderer( std::max( std::atoi( argv[2] ), 1 ) );
+      if (!renderer.isInitialized() || !renderer.setDepthStencilFormat( depth_stencil_format )) return 1;
+      const std::string baseline_path = argc >= 4 ? argv[3] : "";
+      const double threshold = argc >= 5 ? std::atof( argv[4] ) : 5.0;
+      return renderer.benchmark( baseline_path, threshold ) ? 0 : 1;
+   }
+
    RendererGL renderer;
+   if (!renderer.isInitialized() || !renderer.setDepthStencilFormat( depth_stencil_format )) return 1;
    renderer.play();
    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,5 @@
+#version 460
+
+void main()
+{
+}
\ No newline at end of file
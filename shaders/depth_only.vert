@@ -0,0 +1,45 @@
+#version 460
+
+layout (std140, binding = 0) uniform Camera
+{
+   mat4 ViewMatrix;
+   mat4 ProjectionMatrix;
+};
+layout (std140, binding = 1) uniform Transform
+{
+   mat4 WorldMatrix;
+   mat4 ModelViewProjectionMatrix;
+};
+uniform mat4 DequantizationMatrix;
+uniform int UseInstancing;
+uniform int UseDrawData;
+
+// the transforms applied after WorldMatrix for each instance
+layout (std430, binding = 4) readonly buffer InstanceBuffer { mat4 InstanceTransforms[]; };
+
+// the transforms and materials of the static batch for each draw of glMultiDrawElementsIndirect
+struct DrawInfo
+{
+   mat4 WorldMatrix;
+   vec4 EmissionColor;
+   vec4 AmbientColor;
+   vec4 DiffuseColor;
+   vec4 SpecularColor;
+   float SpecularExponent;
+};
+layout (std430, binding = 5) readonly buffer DrawBuffer { DrawInfo Draws[]; };
+
+layout (location = 0) in vec3 v_position;
+
+// This must produce the same depth as the scene shader, or GL_LEQUAL in the shading pass becomes unreliable.
+invariant gl_Position;
+
+void main()
+{
+   vec4 position = DequantizationMatrix * vec4(v_position, 1.0f);
+   mat4 world = WorldMatrix;
+   if (bool(UseDrawData)) world = Draws[gl_DrawID].WorldMatrix;
+   else if (bool(UseInstancing)) world = InstanceTransforms[gl_InstanceID] * WorldMatrix;
+   if (bool(UseDrawData) || bool(UseInstancing)) gl_Position = ProjectionMatrix * ViewMatrix * world * position;
+   else gl_Position = ModelViewProjectionMatrix * position;
+}
\ No newline at end of file
@@ -13,8 +13,15 @@ struct LightInfo
    float SpotlightCutoffAngle;
    float SpotlightFeather;
    float FallOffRadius;
+   int IsBounded; // whether the additive pass of the light is bounded by its falloff sphere
+};
+layout (std140, binding = 2) uniform Lighting
+{
+   LightInfo Lights[MAX_LIGHTS];
+   int UseLight;
+   int LightNum;
+   vec4 GlobalAmbient;
 };
-uniform LightInfo Lights[MAX_LIGHTS];
 
 struct MateralInfo {
    vec4 EmissionColor;
@@ -25,20 +32,42 @@ struct MateralInfo {
 };
 uniform MateralInfo Material;
 
+// the transforms and materials of the static batch for each draw of glMultiDrawElementsIndirect
+struct DrawInfo
+{
+   mat4 WorldMatrix;
+   vec4 EmissionColor;
+   vec4 AmbientColor;
+   vec4 DiffuseColor;
+   vec4 SpecularColor;
+   float SpecularExponent;
+};
+layout (std430, binding = 5) readonly buffer DrawBuffer { DrawInfo Draws[]; };
+
 layout (binding = 0) uniform sampler2D BaseTexture;
 uniform int UseTexture;
 
-uniform int UseLight;
+// the stencil of the shadow volumes resolved at a reduced resolution, and the depth it was rasterized against
+layout (binding = 1) uniform sampler2D ShadowMask;
+layout (binding = 2) uniform sampler2D ShadowMaskDepth;
+uniform int UseShadowMask;
+uniform int ShadowMaskScale;
+
+uniform int UseDrawData;
 uniform int LightIndex;
-uniform int LightNum;
-uniform vec4 GlobalAmbient;
+// 0: everything with the light of LightIndex, 1: emission and global ambient only, 2: the light of LightIndex only
+uniform int LightingPass;
 
-uniform mat4 ViewMatrix;
-uniform mat4 ProjectionMatrix;
+layout (std140, binding = 0) uniform Camera
+{
+   mat4 ViewMatrix;
+   mat4 ProjectionMatrix;
+};
 
 in vec3 position_in_ec;
 in vec3 normal_in_ec;
 in vec2 tex_coord;
+flat in int draw_id;
 
 layout (location = 0) out vec4 final_color;
 
@@ -56,7 +85,12 @@ float getAttenuation(in vec3 light_vector, in int light_index)
    float squared_distance = dot( light_vector, light_vector );
    float distance = sqrt( squared_distance );
    float radius = Lights[light_index].FallOffRadius;
-   if (distance <= radius) return one;
+   bool is_bounded = LightingPass == 2 && bool(Lights[light_index].IsBounded);
+   if (distance <= radius) {
+      // The additive pass of a bounded light ends at its falloff sphere, so it fades out before reaching the bound.
+      return is_bounded ? one - smoothstep( 0.75f * radius, radius, distance ) : one;
+   }
+   if (is_bounded) return zero;
 
    return clamp( radius * radius / squared_distance, zero, one );
 }
@@ -78,11 +112,55 @@ float getSpotlightFactor(in vec3 normalized_light_vector, in int light_index)
    return zero;
 }
 
-vec4 calculateLightingEquation()
+float getLinearDepth(in float depth)
+{
+   float z_ndc = 2.0f * depth - one;
+   return ProjectionMatrix[3][2] / (z_ndc + ProjectionMatrix[2][2]);
+}
+
+float getLightVisibility()
+{
+   if (!bool(UseShadowMask)) return one;
+
+   // The bilinear weights of the four nearest mask texels are scaled down where their depth differs from this pixel,
+   // so that the shadow does not bleed across the depth discontinuities.
+   vec2 coord = gl_FragCoord.xy / float(ShadowMaskScale) - 0.5f;
+   ivec2 base = ivec2(floor( coord ));
+   vec2 f = coord - vec2(base);
+   ivec2 size = textureSize( ShadowMask, 0 ) - 1;
+   float depth = -position_in_ec.z;
+   float shadow = zero;
+   float weight_sum = zero;
+   for (int i = 0; i < 4; ++i) {
+      ivec2 offset = ivec2(i & 1, i >> 1);
+      ivec2 texel = clamp( base + offset, ivec2(0), size );
+      vec2 bilinear = mix( one - f, f, vec2(offset) );
+      float difference = abs( getLinearDepth( texelFetch( ShadowMaskDepth, texel, 0 ).r ) - depth ) / depth;
+      float weight = bilinear.x * bilinear.y / (1e-3f + difference);
+      shadow += weight * texelFetch( ShadowMask, texel, 0 ).r;
+      weight_sum += weight;
+   }
+   return weight_sum > zero ? one - shadow / weight_sum : one;
+}
+
+MateralInfo getMaterial()
+{
+   if (!bool(UseDrawData)) return Material;
+
+   return MateralInfo(
+      Draws[draw_id].EmissionColor,
+      Draws[draw_id].AmbientColor,
+      Draws[draw_id].DiffuseColor,
+      Draws[draw_id].SpecularColor,
+      Draws[draw_id].SpecularExponent
+   );
+}
+
+vec4 calculateLightingEquation(in MateralInfo material)
 {
-   vec4 color = Material.EmissionColor + GlobalAmbient * Material.AmbientColor;
+   vec4 color = LightingPass == 2 ? vec4(zero) : material.EmissionColor + GlobalAmbient * material.AmbientColor;
 
-   if (Lights[LightIndex].LightSwitch == 0) return color;
+   if (LightingPass == 1 || Lights[LightIndex].LightSwitch == 0) return color;
       
    vec4 light_position_in_ec = ViewMatrix * Lights[LightIndex].Position;
       
@@ -99,18 +177,18 @@ vec4 calculateLightingEquation()
    
    if (final_effect_factor <= zero) return color;
 
-   vec4 local_color = Lights[LightIndex].AmbientColor * Material.AmbientColor;
+   vec4 local_color = Lights[LightIndex].AmbientColor * material.AmbientColor;
 
    float diffuse_intensity = max( dot( normal_in_ec, light_vector ), zero );
-   local_color += diffuse_intensity * Lights[LightIndex].DiffuseColor * Material.DiffuseColor;
+   local_color += diffuse_intensity * Lights[LightIndex].DiffuseColor * material.DiffuseColor;
 
    vec3 halfway_vector = normalize( light_vector - normalize( position_in_ec ) );
    float specular_intensity = max( dot( normal_in_ec, halfway_vector ), zero );
    local_color += 
-      pow( specular_intensity, Material.SpecularExponent ) * 
-      Lights[LightIndex].SpecularColor * Material.SpecularColor;
+      pow( specular_intensity, material.SpecularExponent ) * 
+      Lights[LightIndex].SpecularColor * material.SpecularColor;
 
-   color += local_color * final_effect_factor;
+   color += local_color * final_effect_factor * getLightVisibility();
    return color;
 }
 
@@ -119,6 +197,7 @@ void main()
    if (bool(UseTexture)) final_color = texture( BaseTexture, tex_coord );
    else final_color = vec4(one);
 
-   if (bool(UseLight)) final_color *= calculateLightingEquation();
-   else final_color *= Material.DiffuseColor;
+   MateralInfo material = getMaterial();
+   if (bool(UseLight)) final_color *= calculateLightingEquation( material );
+   else final_color *= material.DiffuseColor;
 }
\ No newline at end of file
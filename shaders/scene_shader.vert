@@ -1,9 +1,34 @@
 #version 460
 
-uniform mat4 WorldMatrix;
-uniform mat4 ViewMatrix;
-uniform mat4 ProjectionMatrix;
-uniform mat4 ModelViewProjectionMatrix;
+layout (std140, binding = 0) uniform Camera
+{
+   mat4 ViewMatrix;
+   mat4 ProjectionMatrix;
+};
+layout (std140, binding = 1) uniform Transform
+{
+   mat4 WorldMatrix;
+   mat4 ModelViewProjectionMatrix;
+};
+uniform mat4 DequantizationMatrix;
+uniform int UseCompactVertex;
+uniform int UseInstancing;
+uniform int UseDrawData;
+
+// the transforms applied after WorldMatrix for each instance
+layout (std430, binding = 4) readonly buffer InstanceBuffer { mat4 InstanceTransforms[]; };
+
+// the transforms and materials of the static batch for each draw of glMultiDrawElementsIndirect
+struct DrawInfo
+{
+   mat4 WorldMatrix;
+   vec4 EmissionColor;
+   vec4 AmbientColor;
+   vec4 DiffuseColor;
+   vec4 SpecularColor;
+   float SpecularExponent;
+};
+layout (std430, binding = 5) readonly buffer DrawBuffer { DrawInfo Draws[]; };
 
 layout (location = 0) in vec3 v_position;
 layout (location = 1) in vec3 v_normal;
@@ -12,18 +37,39 @@ layout (location = 2) in vec2 v_tex_coord;
 out vec3 position_in_ec;
 out vec3 normal_in_ec;
 out vec2 tex_coord;
+flat out int draw_id;
+
+// The depth-only prepass writes the depth buffer with the same transformation.
+invariant gl_Position;
+
+vec3 decodeOctahedron(in vec2 encoded)
+{
+   vec3 n = vec3(encoded, 1.0f - abs( encoded.x ) - abs( encoded.y ));
+   if (n.z < 0.0f) n.xy = (1.0f - abs( encoded.yx )) * vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+   return normalize( n );
+}
 
 void main()
 {   
-   vec4 e_position = ViewMatrix * WorldMatrix * vec4(v_position, 1.0f);
+   // In the compact vertex format, positions are quantized in the bounding box and normals are octahedral-encoded.
+   vec4 position = DequantizationMatrix * vec4(v_position, 1.0f);
+   vec3 normal = bool(UseCompactVertex) ? decodeOctahedron( v_normal.xy ) : v_normal;
+
+   mat4 world = WorldMatrix;
+   if (bool(UseDrawData)) world = Draws[gl_DrawID].WorldMatrix;
+   else if (bool(UseInstancing)) world = InstanceTransforms[gl_InstanceID] * WorldMatrix;
+   vec4 e_position = ViewMatrix * world * position;
    // As ViewMatrix * WorldMatrix is rigid body transformation,
    // transpose( inverse( ViewMatrix * WorldMatrix ) ) is equal to ViewMatrix * WorldMatrix.
    // So it is possible to avoid the costly operation to calculate the tranformation for normals.
-   vec4 e_normal = ViewMatrix * WorldMatrix * vec4(v_normal, 0.0f);
+   vec4 e_normal = ViewMatrix * world * vec4(normal, 0.0f);
    position_in_ec = e_position.xyz;
    normal_in_ec = normalize( e_normal.xyz );
 
    tex_coord = v_tex_coord;
+   draw_id = gl_DrawID;
 
-   gl_Position = ModelViewProjectionMatrix * vec4(v_position, 1.0f);
+   // The depth-only prepass must evaluate the same expressions.
+   if (bool(UseDrawData) || bool(UseInstancing)) gl_Position = ProjectionMatrix * ViewMatrix * world * position;
+   else gl_Position = ModelViewProjectionMatrix * position;
 }
\ No newline at end of file
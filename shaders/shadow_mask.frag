@@ -0,0 +1,9 @@
+#version 460
+
+layout (location = 0) out float shadow;
+
+void main()
+{
+   // Only the pixels of nonzero stencil pass, and they are in the shadow.
+   shadow = 1.0f;
+}
\ No newline at end of file
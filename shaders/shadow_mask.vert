@@ -0,0 +1,8 @@
+#version 460
+
+void main()
+{
+   // A triangle covering the whole viewport
+   vec2 position = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 4.0f - 1.0f;
+   gl_Position = vec4(position, 0.0f, 1.0f);
+}
\ No newline at end of file
@@ -1,11 +1,27 @@
 #version 460
 
-uniform mat4 WorldMatrix;
-uniform mat4 ViewMatrix;
+layout (std140, binding = 0) uniform Camera
+{
+   mat4 ViewMatrix;
+   mat4 ProjectionMatrix;
+};
+layout (std140, binding = 1) uniform Transform
+{
+   mat4 WorldMatrix;
+   mat4 ModelViewProjectionMatrix;
+};
+uniform mat4 DequantizationMatrix;
+uniform int UseInstancing;
+
+// the transforms applied after WorldMatrix for each instance
+layout (std430, binding = 4) readonly buffer InstanceBuffer { mat4 InstanceTransforms[]; };
 
 layout (location = 0) in vec3 v_position;
 
 void main()
 {
-   gl_Position = ViewMatrix * WorldMatrix * vec4(v_position, 1.0f);
+   // gl_InstanceID does not count the base instance, which selects a range of the instances.
+   int instance = gl_BaseInstance + gl_InstanceID;
+   mat4 world = bool(UseInstancing) ? InstanceTransforms[instance] * WorldMatrix : WorldMatrix;
+   gl_Position = ViewMatrix * world * DequantizationMatrix * vec4(v_position, 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 460
+
+uniform mat4 ModelViewProjectionMatrix;
+
+// homogeneous object-space positions from ShadowVolumeGenerator, whose w is 0 at infinity
+layout (location = 0) in vec4 v_position;
+
+void main()
+{
+   gl_Position = ModelViewProjectionMatrix * v_position;
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#version 460
+
+uniform mat4 ModelViewMatrix;
+uniform mat4 ProjectionMatrix;
+uniform vec4 LightPosition;
+uniform float ExtrusionRadius; // the volume is extruded to infinity if it is not positive
+uniform int IsZFailAlgorithm;
+uniform int PositionStride; // in 4-byte words
+uniform int UseCompactVertex;
+uniform int UseIndices;
+
+layout (std430, binding = 0) readonly buffer PositionBuffer { uint Positions[]; };
+layout (std430, binding = 1) readonly buffer IndexBuffer { uint Indices[]; };
+layout (std430, binding = 2) readonly buffer RecordBuffer { uint Records[]; };
+
+const float zero = 0.0f;
+const float epsilon = 1e-1f;
+
+// the vertex orders of the triangles shadow_volume.geom emits, as triangle lists
+const uint LightCapOrder[6] = { 0u, 1u, 2u, 0u, 2u, 1u };
+const uint DarkCapOrder[6] = { 0u, 2u, 1u, 0u, 1u, 2u };
+const uint QuadStripOrder[6] = { 0u, 1u, 2u, 2u, 1u, 3u };
+
+vec4 getEyePosition(uint triangle, uint corner)
+{
+   uint index = bool(UseIndices) ? Indices[triangle * 6u + corner] : triangle * 6u + corner;
+   uint offset = index * uint(PositionStride);
+   vec3 position;
+   if (bool(UseCompactVertex)) position = vec3(unpackUnorm2x16( Positions[offset] ), unpackUnorm2x16( Positions[offset + 1u] ).x);
+   else {
+      position = vec3(
+         uintBitsToFloat( Positions[offset] ),
+         uintBitsToFloat( Positions[offset + 1u] ),
+         uintBitsToFloat( Positions[offset + 2u] )
+      );
+   }
+   return ModelViewMatrix * vec4(position, 1.0f);
+}
+
+vec4 getVolumeVertex(vec4 vertex, bool at_infinity)
+{
+   vec3 light_direction = -normalize( LightPosition.xyz - LightPosition.w * vertex.xyz );
+   if (at_infinity) {
+      if (ExtrusionRadius <= zero || LightPosition.w == zero) return ProjectionMatrix * vec4(light_direction, zero);
+
+      vec3 light = LightPosition.xyz / LightPosition.w;
+      // The far vertex is never nearer than the near vertex, so that the volume never turns inside out.
+      float extrusion = max( ExtrusionRadius, distance( light, vertex.xyz / vertex.w ) + epsilon );
+      return ProjectionMatrix * vec4(light + light_direction * extrusion, 1.0f);
+   }
+   return ProjectionMatrix * vec4(vertex.xyz + light_direction * epsilon, vertex.w);
+}
+
+void main()
+{
+   uint record = Records[gl_VertexID / 6];
+   uint corner = uint(gl_VertexID % 6);
+   uint triangle = record >> 3u;
+   bool faces_light = (record & 4u) != 0u;
+   uint kind = record & 3u;
+
+   if (kind == 0u) {
+      // the near cap is the first triangle, and the far cap at infinity is the second
+      // The Z-pass algorithm only closes the far end, so its near cap collapses into a point that is never rasterized.
+      if (corner < 3u && !bool(IsZFailAlgorithm)) {
+         gl_Position = vec4(zero, zero, zero, 1.0f);
+         return;
+      }
+      uint v = faces_light ? LightCapOrder[corner] : DarkCapOrder[corner];
+      gl_Position = getVolumeVertex( getEyePosition( triangle, v * 2u ), corner >= 3u );
+   }
+   else {
+      uint v0 = (kind - 1u) * 2u;
+      uint v1 = (v0 + 2u) % 6u;
+      uint strip_vertex = QuadStripOrder[corner];
+      uint first = faces_light ? v0 : v1;
+      uint second = faces_light ? v1 : v0;
+      gl_Position = getVolumeVertex( getEyePosition( triangle, strip_vertex < 2u ? first : second ), (strip_vertex & 1u) != 0u );
+   }
+}
\ No newline at end of file
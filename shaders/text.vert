@@ -1,10 +1,15 @@
 #version 460
 
-uniform mat4 WorldMatrix;
-uniform mat4 ViewMatrix;
-uniform mat4 ProjectionMatrix;
-uniform mat4 ModelViewProjectionMatrix;
-uniform mat4 LightModelViewProjectionMatrix;
+layout (std140, binding = 0) uniform Camera
+{
+   mat4 ViewMatrix;
+   mat4 ProjectionMatrix;
+};
+layout (std140, binding = 1) uniform Transform
+{
+   mat4 WorldMatrix;
+   mat4 ModelViewProjectionMatrix;
+};
 uniform vec2 TextScale;
 
 layout (location = 0) in vec3 v_position;
@@ -0,0 +1,160 @@
+#include "benchmark.h"
+
+Benchmark::Keyframe Benchmark::getKeyframe(float time) const
+{
+   if (Keyframes.empty()) return {};
+   if (time <= Keyframes.front().Time) return Keyframes.front();
+   if (time >= Keyframes.back().Time) return Keyframes.back();
+
+   const auto next = std::upper_bound(
+      Keyframes.begin(), Keyframes.end(), time,
+      [](float t, const Keyframe& keyframe) { return t < keyframe.Time; }
+   );
+   const auto& k1 = *next;
+   const auto& k0 = *(next - 1);
+   const float t = (time - k0.Time) / std::max( k1.Time - k0.Time, std::numeric_limits<float>::epsilon() );
+   return {
+      time,
+      glm::mix( k0.CameraPosition, k1.CameraPosition, t ),
+      glm::mix( k0.CameraReference, k1.CameraReference, t ),
+      glm::normalize( glm::mix( k0.CameraUp, k1.CameraUp, t ) ),
+      glm::mix( k0.LightPosition, k1.LightPosition, t )
+   };
+}
+
+bool Benchmark::writeReport(const std::string& path) const
+{
+   std::ofstream file( path );
+   if (!file.is_open()) {
+      std::cerr << "Cannot open the benchmark report: " << path << "\n";
+      return false;
+   }
+
+   file << "variant,width,height,frame_num,cpu_mean_ms,gpu_mean_ms,gpu_p50_ms,gpu_p95_ms,gpu_p99_ms,gpu_max_ms\n";
+   file << std::fixed << std::setprecision( 4 );
+   for (const auto& result : Results) {
+      file << "\"" << result.Variant << "\"," << result.Width << "," << result.Height << "," << result.FrameNum << ","
+         << result.CPUMean << "," << result.GPUMean << "," << result.GPUP50 << "," << result.GPUP95 << ","
+         << result.GPUP99 << "," << result.GPUMax << "\n";
+   }
+   return true;
+}
+
+void Benchmark::splitCSVLine(std::vector<std::string>& fields, const std::string& line)
+{
+   fields.clear();
+   std::string field;
+   bool quoted = false;
+   for (const char c : line) {
+      if (c == '"') quoted = !quoted;
+      else if (c == ',' && !quoted) {
+         fields.emplace_back( field );
+         field.clear();
+      }
+      else if (c != '\r') field += c;
+   }
+   fields.emplace_back( field );
+}
+
+bool Benchmark::readReport(std::vector<Result>& results, const std::string& path)
+{
+   std::ifstream file( path );
+   if (!file.is_open()) {
+      std::cerr << "Cannot open the benchmark report: " << path << "\n";
+      return false;
+   }
+
+   // The columns are found by their names, so that a report with more columns can still be a baseline.
+   std::string line;
+   std::vector<std::string> header, fields;
+   if (!std::getline( file, line )) {
+      std::cerr << "The benchmark report is empty: " << path << "\n";
+      return false;
+   }
+   splitCSVLine( header, line );
+   const auto column = [&header](const std::string& name) {
+      const auto it = std::find( header.begin(), header.end(), name );
+      return it == header.end() ? -1 : static_cast<int>(std::distance( header.begin(), it ));
+   };
+   const std::array<int, 10> columns{
+      column( "variant" ), column( "width" ), column( "height" ), column( "frame_num" ), column( "cpu_mean_ms" ),
+      column( "gpu_mean_ms" ), column( "gpu_p50_ms" ), column( "gpu_p95_ms" ), column( "gpu_p99_ms" ),
+      column( "gpu_max_ms" )
+   };
+   if (std::any_of( columns.begin(), columns.end(), [](int c) { return c < 0; } )) {
+      std::cerr << "The benchmark report does not have the expected columns: " << path << "\n";
+      return false;
+   }
+
+   results.clear();
+   int line_num = 1;
+   while (std::getline( file, line )) {
+      line_num++;
+      if (line.empty()) continue;
+
+      splitCSVLine( fields, line );
+      if (fields.size() < header.size()) {
+         std::cerr << "The benchmark report has missing fields at line " << line_num << ": " << path << "\n";
+         return false;
+      }
+
+      Result result;
+      result.Variant = fields[columns[0]];
+      try {
+         result.Width = std::stoi( fields[columns[1]] );
+         result.Height = std::stoi( fields[columns[2]] );
+         result.FrameNum = std::stoi( fields[columns[3]] );
+         result.CPUMean = std::stod( fields[columns[4]] );
+         result.GPUMean = std::stod( fields[columns[5]] );
+         result.GPUP50 = std::stod( fields[columns[6]] );
+         result.GPUP95 = std::stod( fields[columns[7]] );
+         result.GPUP99 = std::stod( fields[columns[8]] );
+         result.GPUMax = std::stod( fields[columns[9]] );
+      }
+      catch (const std::invalid_argument&) {
+         std::cerr << "The benchmark report has a non-numeric field at line " << line_num << ": " << path << "\n";
+         return false;
+      }
+      catch (const std::out_of_range&) {
+         std::cerr << "The benchmark report has a field out of range at line " << line_num << ": " << path << "\n";
+         return false;
+      }
+      results.emplace_back( result );
+   }
+   return true;
+}
+
+int Benchmark::compareWithBaseline(const std::string& baseline_path, double threshold, std::ostream& stream) const
+{
+   std::vector<Result> baseline;
+   if (!readReport( baseline, baseline_path )) {
+      stream << "Cannot compare with the baseline: " << baseline_path << "\n";
+      return -1;
+   }
+
+   int regression_num = 0;
+   stream << std::fixed << std::setprecision( 3 );
+   for (const auto& result : Results) {
+      const auto it = std::find_if(
+         baseline.begin(), baseline.end(),
+         [&result](const Result& base) {
+            return base.Variant == result.Variant && base.Width == result.Width && base.Height == result.Height;
+         }
+      );
+      stream << result.Variant << " " << result.Width << "x" << result.Height << ": " << result.GPUP50 << " ms";
+      if (it == baseline.end()) {
+         stream << " (No Baseline)\n";
+         continue;
+      }
+
+      const double change = it->GPUP50 > 0.0 ? (result.GPUP50 - it->GPUP50) / it->GPUP50 * 100.0 : 0.0;
+      stream << " vs " << it->GPUP50 << " ms (" << std::showpos << std::setprecision( 1 ) << change << "%"
+         << std::noshowpos << std::setprecision( 3 ) << ")";
+      if (change > threshold) {
+         stream << " REGRESSION";
+         regression_num++;
+      }
+      stream << "\n";
+   }
+   return regression_num;
+}
\ No newline at end of file
@@ -21,10 +21,37 @@ CameraGL::CameraGL(
    NearPlane( near_plane ), FarPlane( far_plane ), AspectRatio( 0.0f ), ZoomSensitivity( 1.0f ),
    MoveSensitivity( 0.05f ), RotationSensitivity( 0.005f ), InitCamPos( cam_position ),
    InitRefPos( view_reference_position ), InitUpVec( view_up_vector ), CamPos( cam_position ),
-   ViewMatrix( glm::lookAt( InitCamPos, InitRefPos, InitUpVec ) ), ProjectionMatrix( glm::mat4(1.0f) )
+   ViewMatrix( glm::lookAt( InitCamPos, InitRefPos, InitUpVec ) ), ProjectionMatrix( glm::mat4(1.0f) ),
+   UniformBuffer( 0 ), IsUploaded( false ), UploadedViewMatrix( 1.0f ), UploadedProjectionMatrix( 1.0f ),
+   UploadedViewProjectionMatrix( 1.0f )
 {
 }
 
+CameraGL::~CameraGL()
+{
+   if (UniformBuffer != 0) glDeleteBuffers( 1, &UniformBuffer );
+}
+
+void CameraGL::bindUniformBuffer(GLuint binding) const
+{
+   if (UniformBuffer == 0) {
+      glCreateBuffers( 1, &UniformBuffer );
+      glNamedBufferStorage( UniformBuffer, sizeof( glm::mat4 ) * 2, nullptr, GL_DYNAMIC_STORAGE_BIT );
+      IsUploaded = false;
+   }
+
+   if (!IsUploaded || UploadedViewMatrix != ViewMatrix || UploadedProjectionMatrix != ProjectionMatrix) {
+      // std140 block { mat4 ViewMatrix; mat4 ProjectionMatrix; }
+      const std::array<glm::mat4, 2> matrices{ ViewMatrix, ProjectionMatrix };
+      glNamedBufferSubData( UniformBuffer, 0, sizeof( matrices ), matrices.data() );
+      UploadedViewMatrix = ViewMatrix;
+      UploadedProjectionMatrix = ProjectionMatrix;
+      UploadedViewProjectionMatrix = ProjectionMatrix * ViewMatrix;
+      IsUploaded = true;
+   }
+   StateCacheGL::getInstance().bindUniformBuffer( binding, UniformBuffer );
+}
+
 void CameraGL::updateCamera()
 {
    const glm::mat4 inverse_view = glm::inverse( ViewMatrix );
@@ -188,4 +215,19 @@ float CameraGL::linearizeDepthValue(float depth) const
    const float z_ndc = 2.0f * depth - 1.0f;
    const float z = (2.0f * NearPlane * FarPlane) / (FarPlane + NearPlane - z_ndc * (FarPlane - NearPlane));
    return glm::clamp( (z - NearPlane) / (FarPlane - NearPlane), 0.0f, 1.0f );
+}
+
+void CameraGL::getFrustumPlanes(std::array<glm::vec4, 6>& planes) const
+{
+   const glm::mat4 to_clip = ProjectionMatrix * ViewMatrix;
+   const glm::vec4 row0(to_clip[0][0], to_clip[1][0], to_clip[2][0], to_clip[3][0]);
+   const glm::vec4 row1(to_clip[0][1], to_clip[1][1], to_clip[2][1], to_clip[3][1]);
+   const glm::vec4 row2(to_clip[0][2], to_clip[1][2], to_clip[2][2], to_clip[3][2]);
+   const glm::vec4 row3(to_clip[0][3], to_clip[1][3], to_clip[2][3], to_clip[3][3]);
+   planes[0] = row3 + row0;
+   planes[1] = row3 - row0;
+   planes[2] = row3 + row1;
+   planes[3] = row3 - row1;
+   planes[4] = row3 + row2;
+   planes[5] = row3 - row2;
 }
\ No newline at end of file
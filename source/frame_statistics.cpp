@@ -0,0 +1,205 @@
+#include "frame_statistics.h"
+
+FrameStatistics::FrameStatistics() : RecordedNum( 0 )
+{
+}
+
+void FrameStatistics::initialize(int capacity, const std::vector<std::string>& pass_names)
+{
+   std::lock_guard<std::mutex> lock(Mutex);
+   Frames.assign( std::max( capacity, 1 ), Frame() );
+   PassNames.assign( pass_names.begin(), pass_names.begin() + std::min( static_cast<int>(pass_names.size()), MaxPassNum ) );
+   VariantNames.clear();
+   PendingFrames.clear();
+   RecordedNum = 0;
+}
+
+void FrameStatistics::clear()
+{
+   std::lock_guard<std::mutex> lock(Mutex);
+   PendingFrames.clear();
+   RecordedNum = 0;
+}
+
+int FrameStatistics::getVariantIndex(const std::string& name)
+{
+   std::lock_guard<std::mutex> lock(Mutex);
+   const auto it = std::find( VariantNames.begin(), VariantNames.end(), name );
+   if (it != VariantNames.end()) return static_cast<int>(std::distance( VariantNames.begin(), it ));
+
+   VariantNames.emplace_back( name );
+   return static_cast<int>(VariantNames.size()) - 1;
+}
+
+void FrameStatistics::record(const Frame& frame)
+{
+   Frames[RecordedNum % Frames.size()] = frame;
+   RecordedNum++;
+}
+
+void FrameStatistics::submit(uint64_t frame_id, const Frame& frame)
+{
+   std::lock_guard<std::mutex> lock(Mutex);
+   // The frames that wait longer than the buffer can hold have lost their GPU times anyway.
+   while (PendingFrames.size() >= Frames.size()) {
+      record( PendingFrames.front().second );
+      PendingFrames.pop_front();
+   }
+   PendingFrames.emplace_back( frame_id, frame );
+}
+
+void FrameStatistics::resolve(uint64_t frame_id, const std::vector<double>& pass_times)
+{
+   std::lock_guard<std::mutex> lock(Mutex);
+   while (!PendingFrames.empty() && PendingFrames.front().first <= frame_id) {
+      Frame& frame = PendingFrames.front().second;
+      if (PendingFrames.front().first == frame_id) {
+         const auto pass_num = std::min( static_cast<int>(pass_times.size()), MaxPassNum );
+         std::copy( pass_times.begin(), pass_times.begin() + pass_num, frame.PassTimes.begin() );
+         frame.HasGPUTimes = true;
+      }
+      record( frame );
+      PendingFrames.pop_front();
+   }
+}
+
+void FrameStatistics::flushPending()
+{
+   std::lock_guard<std::mutex> lock(Mutex);
+   for (const auto& pending : PendingFrames) record( pending.second );
+   PendingFrames.clear();
+}
+
+void FrameStatistics::getSnapshot(std::vector<Frame>& frames) const
+{
+   std::lock_guard<std::mutex> lock(Mutex);
+   const uint64_t frame_num = std::min( RecordedNum, static_cast<uint64_t>(Frames.size()) );
+   frames.resize( frame_num );
+   for (uint64_t i = 0; i < frame_num; ++i) frames[i] = Frames[(RecordedNum - frame_num + i) % Frames.size()];
+}
+
+uint64_t FrameStatistics::getRecordedNum() const
+{
+   std::lock_guard<std::mutex> lock(Mutex);
+   return RecordedNum;
+}
+
+std::vector<std::string> FrameStatistics::getVariantNames() const
+{
+   std::lock_guard<std::mutex> lock(Mutex);
+   return VariantNames;
+}
+
+std::string FrameStatistics::getMetricName(int metric) const
+{
+   const auto pass_num = static_cast<int>(PassNames.size());
+   if (metric == 0) return "cpu_frame_ms";
+   if (metric == 1) return "swap_interval_ms";
+   if (metric < pass_num + 2) {
+      std::string name = PassNames[metric - 2];
+      std::transform( name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower( c ); } );
+      return "gpu_" + name + "_ms";
+   }
+   return "gpu_total_ms";
+}
+
+double FrameStatistics::getMetric(const Frame& frame, int metric, int pass_num)
+{
+   if (metric == 0) return frame.CPUFrameTime;
+   if (metric == 1) return frame.SwapInterval;
+   if (metric < pass_num + 2) return frame.PassTimes[metric - 2];
+   return std::accumulate( frame.PassTimes.begin(), frame.PassTimes.begin() + pass_num, 0.0 );
+}
+
+FrameStatistics::Summary FrameStatistics::summarize(const std::vector<Frame>& frames, int metric, int variant) const
+{
+   const auto pass_num = static_cast<int>(PassNames.size());
+   std::vector<double> values;
+   values.reserve( frames.size() );
+   for (const auto& frame : frames) {
+      if (variant >= 0 && frame.Variant != variant) continue;
+      if (isGPUMetric( metric ) && !frame.HasGPUTimes) continue;
+      values.emplace_back( getMetric( frame, metric, pass_num ) );
+   }
+
+   Summary summary;
+   if (values.empty()) return summary;
+
+   // The nearest-rank percentiles of the sorted values
+   std::sort( values.begin(), values.end() );
+   const auto percentile = [&values](double p) {
+      const auto rank = static_cast<size_t>(std::ceil( p * static_cast<double>(values.size()) ));
+      return values[std::clamp( rank, static_cast<size_t>(1), values.size() ) - 1];
+   };
+   summary.Mean = std::accumulate( values.begin(), values.end(), 0.0 ) / static_cast<double>(values.size());
+   summary.P50 = percentile( 0.5 );
+   summary.P95 = percentile( 0.95 );
+   summary.P99 = percentile( 0.99 );
+   summary.Max = values.back();
+   return summary;
+}
+
+bool FrameStatistics::writeCSV(const std::string& path) const
+{
+   std::ofstream file( path );
+   if (!file.is_open()) {
+      std::cerr << "Cannot open the statistics file: " << path << "\n";
+      return false;
+   }
+
+   std::vector<Frame> frames;
+   getSnapshot( frames );
+   const std::vector<std::string> variant_names = getVariantNames();
+   const auto pass_num = static_cast<int>(PassNames.size());
+   file << "frame,variant";
+   for (int m = 0; m < getMetricNum(); ++m) file << "," << getMetricName( m );
+   file << "\n" << std::fixed << std::setprecision( 4 );
+   for (size_t i = 0; i < frames.size(); ++i) {
+      file << i << ",\"" << variant_names[frames[i].Variant] << "\"";
+      for (int m = 0; m < getMetricNum(); ++m) {
+         // The field is left empty if the GPU times of the frame were dropped.
+         file << ",";
+         if (!isGPUMetric( m ) || frames[i].HasGPUTimes) file << getMetric( frames[i], m, pass_num );
+      }
+      file << "\n";
+   }
+   return true;
+}
+
+bool FrameStatistics::writeJSON(const std::string& path) const
+{
+   std::ofstream file( path );
+   if (!file.is_open()) {
+      std::cerr << "Cannot open the statistics file: " << path << "\n";
+      return false;
+   }
+
+   std::vector<Frame> frames;
+   getSnapshot( frames );
+   const std::vector<std::string> variant_names = getVariantNames();
+   const auto pass_num = static_cast<int>(PassNames.size());
+   file << std::fixed << std::setprecision( 4 );
+   file << "{\n   \"frame_num\": " << frames.size() << ",\n   \"summary\": {";
+   for (size_t v = 0; v < variant_names.size(); ++v) {
+      file << (v > 0 ? "," : "") << "\n      \"" << variant_names[v] << "\": {";
+      for (int m = 0; m < getMetricNum(); ++m) {
+         const Summary summary = summarize( frames, m, static_cast<int>(v) );
+         file << (m > 0 ? "," : "") << "\n         \"" << getMetricName( m ) << "\": { "
+            << "\"mean\": " << summary.Mean << ", \"p50\": " << summary.P50 << ", \"p95\": " << summary.P95
+            << ", \"p99\": " << summary.P99 << ", \"max\": " << summary.Max << " }";
+      }
+      file << "\n      }";
+   }
+   file << "\n   },\n   \"frames\": [";
+   for (size_t i = 0; i < frames.size(); ++i) {
+      file << (i > 0 ? "," : "") << "\n      { \"variant\": \"" << variant_names[frames[i].Variant] << "\"";
+      for (int m = 0; m < getMetricNum(); ++m) {
+         file << ", \"" << getMetricName( m ) << "\": ";
+         if (!isGPUMetric( m ) || frames[i].HasGPUTimes) file << getMetric( frames[i], m, pass_num );
+         else file << "null";
+      }
+      file << " }";
+   }
+   file << "\n   ]\n}\n";
+   return true;
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "gpu_profiler.h"
+
+GPUProfilerGL::GPUProfilerGL() : FrameIndex( 0 ), FrameId( 0 ), AveragedFrameNum( 0 ), Frames()
+{
+}
+
+GPUProfilerGL::~GPUProfilerGL()
+{
+   release();
+}
+
+void GPUProfilerGL::release()
+{
+   for (auto& frame : Frames) {
+      for (const auto& interval : frame.Intervals) {
+         glDeleteQueries( 1, &interval.BeginQuery );
+         glDeleteQueries( 1, &interval.EndQuery );
+      }
+      frame.Intervals.clear();
+      frame.IntervalNum = 0;
+      frame.FrameId = 0;
+   }
+   ResolvedFrames.clear();
+}
+
+void GPUProfilerGL::initialize(const std::vector<std::string>& pass_names)
+{
+   release();
+
+   PassNames = pass_names;
+   OpenIntervals.assign( PassNames.size(), -1 );
+   PassTimes.assign( PassNames.size(), 0.0 );
+   PassTimeSums.assign( PassNames.size(), 0.0 );
+   FrameIndex = 0;
+   FrameId = 0;
+   AveragedFrameNum = 0;
+}
+
+void GPUProfilerGL::collect(FrameQueries& frame)
+{
+   if (frame.FrameId == 0) return;
+
+   const uint64_t frame_id = frame.FrameId;
+   frame.FrameId = 0;
+   if (frame.IntervalNum == 0) {
+      if (ResolvedFrames.size() == MaxResolvedFrameNum) ResolvedFrames.pop_front();
+      ResolvedFrames.emplace_back( frame_id, std::vector<double>(PassNames.size(), 0.0) );
+      return;
+   }
+
+   // The queries complete in order, so all the results are ready if the last one is.
+   GLint available = GL_FALSE;
+   glGetQueryObjectiv( frame.Intervals[frame.IntervalNum - 1].EndQuery, GL_QUERY_RESULT_AVAILABLE, &available );
+   if (available == GL_FALSE) return;
+
+   std::fill( PassTimes.begin(), PassTimes.end(), 0.0 );
+   for (int i = 0; i < frame.IntervalNum; ++i) {
+      GLuint64 begin_time = 0, end_time = 0;
+      glGetQueryObjectui64v( frame.Intervals[i].BeginQuery, GL_QUERY_RESULT, &begin_time );
+      glGetQueryObjectui64v( frame.Intervals[i].EndQuery, GL_QUERY_RESULT, &end_time );
+      PassTimes[frame.Intervals[i].Pass] += static_cast<double>(end_time - begin_time) * 1e-6;
+   }
+   for (size_t i = 0; i < PassTimes.size(); ++i) PassTimeSums[i] += PassTimes[i];
+   AveragedFrameNum++;
+   if (ResolvedFrames.size() == MaxResolvedFrameNum) ResolvedFrames.pop_front();
+   ResolvedFrames.emplace_back( frame_id, PassTimes );
+}
+
+void GPUProfilerGL::beginFrame()
+{
+   FrameIndex = (FrameIndex + 1) % FrameBufferNum;
+
+   // If the GPU is still behind, this frame is dropped from the statistics instead of waiting for it.
+   FrameQueries& frame = Frames[FrameIndex];
+   collect( frame );
+   frame.IntervalNum = 0;
+   frame.FrameId = ++FrameId;
+   std::fill( OpenIntervals.begin(), OpenIntervals.end(), -1 );
+}
+
+void GPUProfilerGL::flush()
+{
+   glFinish();
+
+   // from the oldest frame to the current one
+   for (int i = 1; i <= FrameBufferNum; ++i) collect( Frames[(FrameIndex + i) % FrameBufferNum] );
+}
+
+bool GPUProfilerGL::popResolvedFrame(uint64_t& frame_id, std::vector<double>& pass_times)
+{
+   if (ResolvedFrames.empty()) return false;
+
+   frame_id = ResolvedFrames.front().first;
+   pass_times = std::move( ResolvedFrames.front().second );
+   ResolvedFrames.pop_front();
+   return true;
+}
+
+void GPUProfilerGL::begin(int pass)
+{
+   FrameQueries& frame = Frames[FrameIndex];
+   if (frame.IntervalNum == static_cast<int>(frame.Intervals.size())) {
+      Interval interval{ pass, 0, 0 };
+      glCreateQueries( GL_TIMESTAMP, 1, &interval.BeginQuery );
+      glCreateQueries( GL_TIMESTAMP, 1, &interval.EndQuery );
+      frame.Intervals.emplace_back( interval );
+   }
+   Interval& interval = frame.Intervals[frame.IntervalNum];
+   interval.Pass = pass;
+   glQueryCounter( interval.BeginQuery, GL_TIMESTAMP );
+   OpenIntervals[pass] = frame.IntervalNum;
+   frame.IntervalNum++;
+}
+
+void GPUProfilerGL::end(int pass)
+{
+   if (OpenIntervals[pass] < 0) return;
+
+   glQueryCounter( Frames[FrameIndex].Intervals[OpenIntervals[pass]].EndQuery, GL_TIMESTAMP );
+   OpenIntervals[pass] = -1;
+}
+
+void GPUProfilerGL::log(std::ostream& stream)
+{
+   if (AveragedFrameNum == 0) return;
+
+   double frame_time = 0.0;
+   stream << "GPU Time over " << AveragedFrameNum << " Frames:";
+   for (size_t i = 0; i < PassNames.size(); ++i) {
+      const double average = PassTimeSums[i] / static_cast<double>(AveragedFrameNum);
+      stream << " " << PassNames[i] << " " << std::fixed << std::setprecision( 3 ) << average << " ms,";
+      frame_time += average;
+   }
+   stream << " Total " << frame_time << " ms\n";
+
+   std::fill( PassTimeSums.begin(), PassTimeSums.end(), 0.0 );
+   AveragedFrameNum = 0;
+}
\ No newline at end of file
@@ -1,10 +1,16 @@
 #include "light.h"
 
 LightGL::LightGL() :
-   TurnLightOn( true ), GlobalAmbientColor( 0.2f, 0.2f, 0.2f, 1.0f ), TotalLightNum( 0 )
+   IsDirty( true ), TurnLightOn( true ), TotalLightNum( 0 ), GlobalAmbientColor( 0.2f, 0.2f, 0.2f, 1.0f ),
+   UniformBuffer( 0 )
 {
 }
 
+LightGL::~LightGL()
+{
+   if (UniformBuffer != 0) glDeleteBuffers( 1, &UniformBuffer );
+}
+
 bool LightGL::isLightOn() const
 {
    return TurnLightOn;
@@ -13,6 +19,7 @@ bool LightGL::isLightOn() const
 void LightGL::toggleLightSwitch()
 {
    TurnLightOn = !TurnLightOn;
+   IsDirty = true;
 }
 
 void LightGL::addLight(
@@ -23,7 +30,8 @@ void LightGL::addLight(
    const glm::vec3& spotlight_direction,
    float spotlight_cutoff_angle_in_degree,
    float spotlight_feather,
-   float falloff_radius
+   float falloff_radius,
+   bool is_bounded
 )
 {
    Positions.emplace_back( light_position );
@@ -36,39 +44,57 @@ void LightGL::addLight(
    SpotlightCutoffAngles.emplace_back( spotlight_cutoff_angle_in_degree );
    SpotlightFeathers.emplace_back( spotlight_feather );
    FallOffRadii.emplace_back( falloff_radius );
+   IsBounded.emplace_back( is_bounded );
 
    IsActivated.emplace_back( true );
 
    TotalLightNum = static_cast<int>(Positions.size());
+   IsDirty = true;
 }
 
 void LightGL::activateLight(const int& light_index)
 {
    if (light_index >= TotalLightNum) return;
    IsActivated[light_index] = true;
+   IsDirty = true;
 }
 
 void LightGL::deactivateLight(const int& light_index)
 {
    if (light_index >= TotalLightNum) return;
    IsActivated[light_index] = false;
+   IsDirty = true;
 }
 
-void LightGL::transferUniformsToShader(const ShaderGL* shader)
+void LightGL::bindUniformBuffer(GLuint binding)
 {
-   glUniform1i( shader->getLightAvailabilityLocation(), TurnLightOn ? 1 : 0 );
-   glUniform1i( shader->getLightNumLocation(), static_cast<GLint>(TotalLightNum) );
-   glUniform4fv( shader->getGlobalAmbientLocation(), 1, &GlobalAmbientColor[0] );
+   if (UniformBuffer == 0) {
+      glCreateBuffers( 1, &UniformBuffer );
+      glNamedBufferStorage( UniformBuffer, sizeof( LightBlock ), nullptr, GL_DYNAMIC_STORAGE_BIT );
+      IsDirty = true;
+   }
 
-   for (int i = 0; i < TotalLightNum; ++i) {
-      glUniform1i( shader->getLightSwitchLocation( i ), IsActivated[0] ? 1 : 0 );
-      glUniform4fv( shader->getLightPositionLocation( i ), 1, &Positions[i][0] );
-      glUniform4fv( shader->getLightAmbientLocation( i ), 1, &AmbientColors[i][0] );
-      glUniform4fv( shader->getLightDiffuseLocation( i ), 1, &DiffuseColors[i][0] );
-      glUniform4fv( shader->getLightSpecularLocation( i ), 1, &SpecularColors[i][0] );
-      glUniform3fv( shader->getLightSpotlightDirectionLocation( i ), 1, &SpotlightDirections[i][0] );
-      glUniform1f( shader->getLightSpotlightCutoffAngleLocation( i ), SpotlightCutoffAngles[i] );
-      glUniform1f( shader->getLightSpotlightFeatherLocation( i ), SpotlightFeathers[i] );
-      glUniform1f( shader->getLightFallOffRadiusLocation( i ), FallOffRadii[i] );
+   if (IsDirty) {
+      LightBlock block{};
+      const int light_num = std::min( TotalLightNum, MaxLightNum );
+      block.UseLight = TurnLightOn ? 1 : 0;
+      block.LightNum = light_num;
+      block.GlobalAmbient = GlobalAmbientColor;
+      for (int i = 0; i < light_num; ++i) {
+         LightBlockElement& light = block.Lights[i];
+         light.LightSwitch = IsActivated[i] ? 1 : 0;
+         light.Position = Positions[i];
+         light.AmbientColor = AmbientColors[i];
+         light.DiffuseColor = DiffuseColors[i];
+         light.SpecularColor = SpecularColors[i];
+         light.SpotlightDirection = SpotlightDirections[i];
+         light.SpotlightCutoffAngle = SpotlightCutoffAngles[i];
+         light.SpotlightFeather = SpotlightFeathers[i];
+         light.FallOffRadius = FallOffRadii[i];
+         light.IsBounded = IsBounded[i] ? 1 : 0;
+      }
+      glNamedBufferSubData( UniformBuffer, 0, sizeof( LightBlock ), &block );
+      IsDirty = false;
    }
+   StateCacheGL::getInstance().bindUniformBuffer( binding, UniformBuffer );
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile() :
+   IsOpen( false ), Data( nullptr ), Size( 0 ),
+#ifdef _WIN32
+   FileHandle( INVALID_HANDLE_VALUE ), MappingHandle( nullptr )
+#else
+   FileDescriptor( -1 )
+#endif
+{
+}
+
+MappedFile::MappedFile(const std::string& file_path) : MappedFile()
+{
+   open( file_path );
+}
+
+MappedFile::~MappedFile()
+{
+   close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& file_path)
+{
+   close();
+
+   FileHandle = CreateFileA(
+      file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+      OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+   );
+   if (FileHandle == INVALID_HANDLE_VALUE) return false;
+
+   LARGE_INTEGER file_size;
+   if (!GetFileSizeEx( FileHandle, &file_size )) {
+      close();
+      return false;
+   }
+
+   Size = static_cast<size_t>(file_size.QuadPart);
+   if (Size > 0) {
+      MappingHandle = CreateFileMappingA( FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+      if (MappingHandle == nullptr) {
+         close();
+         return false;
+      }
+      Data = static_cast<const char*>(MapViewOfFile( MappingHandle, FILE_MAP_READ, 0, 0, 0 ));
+      if (Data == nullptr) {
+         close();
+         return false;
+      }
+   }
+   IsOpen = true;
+   return true;
+}
+
+void MappedFile::close()
+{
+   if (Data != nullptr) UnmapViewOfFile( Data );
+   if (MappingHandle != nullptr) CloseHandle( MappingHandle );
+   if (FileHandle != INVALID_HANDLE_VALUE) CloseHandle( FileHandle );
+   IsOpen = false;
+   Data = nullptr;
+   Size = 0;
+   FileHandle = INVALID_HANDLE_VALUE;
+   MappingHandle = nullptr;
+}
+#else
+bool MappedFile::open(const std::string& file_path)
+{
+   close();
+
+   FileDescriptor = ::open( file_path.c_str(), O_RDONLY );
+   if (FileDescriptor < 0) return false;
+
+   struct stat file_status{};
+   if (fstat( FileDescriptor, &file_status ) != 0) {
+      close();
+      return false;
+   }
+
+   // An empty file cannot be mapped, but it is still a valid (empty) input.
+   Size = static_cast<size_t>(file_status.st_size);
+   if (Size > 0) {
+      void* data = mmap( nullptr, Size, PROT_READ, MAP_PRIVATE, FileDescriptor, 0 );
+      if (data == MAP_FAILED) {
+         close();
+         return false;
+      }
+      madvise( data, Size, MADV_SEQUENTIAL );
+      Data = static_cast<const char*>(data);
+   }
+   IsOpen = true;
+   return true;
+}
+
+void MappedFile::close()
+{
+   if (Data != nullptr) munmap( const_cast<char*>(Data), Size );
+   if (FileDescriptor >= 0) ::close( FileDescriptor );
+   IsOpen = false;
+   Data = nullptr;
+   Size = 0;
+   FileDescriptor = -1;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,560 @@
+#include "mesh_optimizer.h"
+
+int MeshOptimizer::getNextVertex(
+   const std::vector<int>& live_primitive_nums,
+   const std::vector<int>& cache_time_stamps,
+   const std::vector<GLuint>& candidates,
+   std::vector<GLuint>& dead_ends,
+   int& cursor,
+   int time_stamp,
+   int cache_size
+)
+{
+   // Prefer the candidate which will still be in the cache after its remaining primitives are emitted.
+   int next = -1, max_priority = -1;
+   for (const auto& v : candidates) {
+      if (live_primitive_nums[v] <= 0) continue;
+
+      int priority = 0;
+      const int age = time_stamp - cache_time_stamps[v];
+      if (age + 2 * live_primitive_nums[v] <= cache_size) priority = age;
+      if (priority > max_priority) {
+         max_priority = priority;
+         next = static_cast<int>(v);
+      }
+   }
+   if (next >= 0) return next;
+
+   while (!dead_ends.empty()) {
+      const GLuint v = dead_ends.back();
+      dead_ends.pop_back();
+      if (live_primitive_nums[v] > 0) return static_cast<int>(v);
+   }
+
+   const auto vertex_num = static_cast<int>(live_primitive_nums.size());
+   while (cursor < vertex_num) {
+      if (live_primitive_nums[cursor] > 0) return cursor;
+      cursor++;
+   }
+   return -1;
+}
+
+void MeshOptimizer::reorderPrimitives(
+   std::vector<GLuint>& indices,
+   size_t vertex_num,
+   int primitive_size,
+   int cache_size
+)
+{
+   const size_t primitive_num = indices.size() / primitive_size;
+   if (primitive_num == 0) return;
+
+   // vertex-to-primitive adjacency in the compressed sparse row format
+   std::vector<int> live_primitive_nums(vertex_num, 0);
+   for (const auto& index : indices) live_primitive_nums[index]++;
+   std::vector<size_t> offsets(vertex_num + 1, 0);
+   for (size_t v = 0; v < vertex_num; ++v) offsets[v + 1] = offsets[v] + live_primitive_nums[v];
+   std::vector<GLuint> primitives(indices.size());
+   std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+   for (size_t i = 0; i < indices.size(); ++i) primitives[fill[indices[i]]++] = static_cast<GLuint>(i / primitive_size);
+
+   std::vector<GLuint> order;
+   std::vector<GLuint> candidates, dead_ends;
+   std::vector<bool> emitted(primitive_num, false);
+   std::vector<int> cache_time_stamps(vertex_num, 0);
+   order.reserve( primitive_num );
+   dead_ends.reserve( indices.size() );
+   int time_stamp = cache_size + 1, cursor = 0;
+   int fanning_vertex = getNextVertex( live_primitive_nums, cache_time_stamps, candidates, dead_ends, cursor, time_stamp, cache_size );
+   while (fanning_vertex >= 0) {
+      candidates.clear();
+      for (size_t p = offsets[fanning_vertex]; p < offsets[fanning_vertex + 1]; ++p) {
+         const GLuint primitive = primitives[p];
+         if (emitted[primitive]) continue;
+
+         emitted[primitive] = true;
+         order.emplace_back( primitive );
+         for (int j = 0; j < primitive_size; ++j) {
+            const GLuint v = indices[primitive * primitive_size + j];
+            dead_ends.emplace_back( v );
+            candidates.emplace_back( v );
+            live_primitive_nums[v]--;
+            if (time_stamp - cache_time_stamps[v] > cache_size) {
+               cache_time_stamps[v] = time_stamp;
+               time_stamp++;
+            }
+         }
+      }
+      fanning_vertex = getNextVertex( live_primitive_nums, cache_time_stamps, candidates, dead_ends, cursor, time_stamp, cache_size );
+   }
+
+   std::vector<GLuint> reordered;
+   reordered.reserve( indices.size() );
+   for (const auto& primitive : order) {
+      const auto first = indices.begin() + static_cast<std::ptrdiff_t>(primitive) * primitive_size;
+      reordered.insert( reordered.end(), first, first + primitive_size );
+   }
+   indices = std::move( reordered );
+}
+
+void MeshOptimizer::reorderVertices(std::vector<GLuint>& remap, std::vector<GLuint>& indices, size_t vertex_num)
+{
+   constexpr auto unassigned = std::numeric_limits<GLuint>::max();
+   remap.assign( vertex_num, unassigned );
+
+   GLuint next = 0;
+   for (auto& index : indices) {
+      if (remap[index] == unassigned) remap[index] = next++;
+      index = remap[index];
+   }
+
+   // Vertices no primitive uses are kept at the end.
+   for (auto& new_index : remap) {
+      if (new_index == unassigned) new_index = next++;
+   }
+}
+
+float MeshOptimizer::getACMR(const std::vector<GLuint>& indices, int primitive_size, int cache_size)
+{
+   const size_t primitive_num = indices.size() / primitive_size;
+   if (primitive_num == 0) return 0.0f;
+
+   std::vector<GLuint> cache(cache_size, std::numeric_limits<GLuint>::max());
+   int head = 0, transform_num = 0;
+   for (const auto& index : indices) {
+      if (std::find( cache.begin(), cache.end(), index ) != cache.end()) continue;
+
+      cache[head] = index;
+      head = (head + 1) % cache_size;
+      transform_num++;
+   }
+   return static_cast<float>(transform_num) / static_cast<float>(primitive_num);
+}
+
+uint64_t MeshOptimizer::getPositionHash(const glm::vec3& position)
+{
+   uint64_t hash = 0;
+   for (int i = 0; i < 3; ++i) {
+      // -0 and +0 are the same position.
+      uint32_t bits = 0;
+      if (position[i] != 0.0f) std::memcpy( &bits, &position[i], sizeof( bits ) );
+      hash = (hash ^ bits) * 0x9E3779B97F4A7C15ull;
+   }
+   // The low bits of the product only depend on the low mantissa bits, which are often zero, so mix them down.
+   hash ^= hash >> 33;
+   hash *= 0xFF51AFD7ED558CCDull;
+   return hash ^ (hash >> 33);
+}
+
+void MeshOptimizer::weldVertices(
+   std::vector<GLuint>& welded_indices,
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<GLuint>& indices,
+   ThreadPool& pool
+)
+{
+   const size_t vertex_num = vertices.size();
+   std::vector<GLuint> first_uses, used_vertices;
+   getFirstUses( first_uses, used_vertices, indices, vertex_num );
+
+   // An open-addressing table of the distinct positions.
+   // A slot holds (first use << 32) | vertex, so the atomic minimum keeps the vertex which is referenced first.
+   constexpr auto empty = std::numeric_limits<uint64_t>::max();
+   size_t capacity = 1;
+   while (capacity < vertex_num * 2) capacity <<= 1;
+   const size_t mask = capacity - 1;
+   std::unique_ptr<std::atomic<uint64_t>[]> slots(new std::atomic<uint64_t>[capacity]);
+   const int slot_task_num = getTaskNum( capacity, pool );
+   pool.run(
+      slot_task_num, [&](int t) {
+         const size_t end = getTaskBegin( capacity, t + 1, slot_task_num );
+         for (size_t i = getTaskBegin( capacity, t, slot_task_num ); i < end; ++i) {
+            slots[i].store( empty, std::memory_order_relaxed );
+         }
+      }
+   );
+
+   // The slot of each vertex is kept, so resolving the winners does not need to probe again.
+   std::vector<size_t> vertex_slots(vertex_num);
+   const int vertex_task_num = getTaskNum( vertex_num, pool );
+   pool.run(
+      vertex_task_num, [&](int t) {
+         const size_t end = getTaskBegin( vertex_num, t + 1, vertex_task_num );
+         for (size_t v = getTaskBegin( vertex_num, t, vertex_task_num ); v < end; ++v) {
+            if (first_uses[v] == NoIndex) continue;
+
+            const uint64_t entry = static_cast<uint64_t>(first_uses[v]) << 32 | v;
+            size_t slot = getPositionHash( vertices[v] ) & mask;
+            while (true) {
+               uint64_t occupant = slots[slot].load( std::memory_order_acquire );
+               if (occupant == empty) {
+                  if (slots[slot].compare_exchange_weak( occupant, entry )) break;
+                  continue;
+               }
+               if (vertices[static_cast<GLuint>(occupant)] == vertices[v]) {
+                  while (entry < occupant && !slots[slot].compare_exchange_weak( occupant, entry )) {}
+                  break;
+               }
+               slot = (slot + 1) & mask;
+            }
+            vertex_slots[v] = slot;
+         }
+      }
+   );
+
+   std::vector<GLuint> welded_vertices(vertex_num, NoIndex);
+   pool.run(
+      vertex_task_num, [&](int t) {
+         const size_t end = getTaskBegin( vertex_num, t + 1, vertex_task_num );
+         for (size_t v = getTaskBegin( vertex_num, t, vertex_task_num ); v < end; ++v) {
+            if (first_uses[v] == NoIndex) continue;
+            welded_vertices[v] = static_cast<GLuint>(slots[vertex_slots[v]].load( std::memory_order_relaxed ));
+         }
+      }
+   );
+
+   remapIndices( welded_indices, indices, welded_vertices, pool );
+}
+
+void MeshOptimizer::remapIndices(
+   std::vector<GLuint>& remapped_indices,
+   const std::vector<GLuint>& indices,
+   const std::vector<GLuint>& remap,
+   ThreadPool& pool
+)
+{
+   remapped_indices.resize( indices.size() );
+   const int task_num = getTaskNum( indices.size(), pool );
+   pool.run(
+      task_num, [&](int t) {
+         const size_t end = getTaskBegin( indices.size(), t + 1, task_num );
+         for (size_t i = getTaskBegin( indices.size(), t, task_num ); i < end; ++i) {
+            remapped_indices[i] = remap[indices[i]];
+         }
+      }
+   );
+}
+
+void MeshOptimizer::getFirstUses(
+   std::vector<GLuint>& first_uses,
+   std::vector<GLuint>& used_vertices,
+   const std::vector<GLuint>& indices,
+   size_t vertex_num
+)
+{
+   first_uses.assign( vertex_num, NoIndex );
+   used_vertices.clear();
+   for (size_t i = 0; i < indices.size(); ++i) {
+      if (first_uses[indices[i]] == NoIndex) {
+         first_uses[indices[i]] = static_cast<GLuint>(i);
+         used_vertices.emplace_back( indices[i] );
+      }
+   }
+}
+
+glm::i64vec3 MeshOptimizer::getCell(const glm::vec3& position, float cell_size)
+{
+   return {
+      static_cast<int64_t>(std::floor( position.x / cell_size )),
+      static_cast<int64_t>(std::floor( position.y / cell_size )),
+      static_cast<int64_t>(std::floor( position.z / cell_size ))
+   };
+}
+
+uint64_t MeshOptimizer::getCellHash(const glm::i64vec3& cell)
+{
+   uint64_t hash = 0;
+   for (int i = 0; i < 3; ++i) hash = (hash ^ static_cast<uint64_t>(cell[i])) * 0x9E3779B97F4A7C15ull;
+   hash ^= hash >> 33;
+   hash *= 0xFF51AFD7ED558CCDull;
+   return hash ^ (hash >> 33);
+}
+
+size_t MeshOptimizer::weldVerticesWithTolerance(
+   std::vector<GLuint>& welded_indices,
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<GLuint>& indices,
+   float epsilon,
+   ThreadPool& pool
+)
+{
+   std::vector<GLuint> first_uses, used_vertices;
+   getFirstUses( first_uses, used_vertices, indices, vertices.size() );
+   const size_t used_num = used_vertices.size();
+
+   // With cells of 2 * epsilon, every vertex within epsilon lies in one of the 8 cells
+   // on the side of the cell half the vertex is in.
+   const float cell_size = 2.0f * epsilon;
+   std::vector<SortKey> cells(used_num);
+   const int task_num = getTaskNum( used_num, pool );
+   pool.run(
+      task_num, [&](int t) {
+         const size_t end = getTaskBegin( used_num, t + 1, task_num );
+         for (size_t i = getTaskBegin( used_num, t, task_num ); i < end; ++i) {
+            cells[i].Key = getCellHash( getCell( vertices[used_vertices[i]], cell_size ) );
+            cells[i].Value = used_vertices[i];
+         }
+      }
+   );
+   sortKeys( cells, 64, pool );
+
+   // An open-addressing table from a cell hash to its range in the sorted cells
+   struct CellRange
+   {
+      uint64_t Key;
+      GLuint Begin, End;
+   };
+   size_t capacity = 1;
+   while (capacity < used_num * 2) capacity <<= 1;
+   const size_t mask = capacity - 1;
+   std::vector<CellRange> ranges(capacity, CellRange{ 0, 0, 0 });
+   for (size_t i = 0; i < used_num;) {
+      size_t j = i + 1;
+      while (j < used_num && cells[j].Key == cells[i].Key) j++;
+
+      size_t slot = cells[i].Key & mask;
+      while (ranges[slot].End != 0) slot = (slot + 1) & mask;
+      ranges[slot] = { cells[i].Key, static_cast<GLuint>(i), static_cast<GLuint>(j) };
+      i = j;
+   }
+
+   // The candidates of a vertex are the vertices within epsilon which are referenced earlier.
+   const float squared_epsilon = epsilon * epsilon;
+   const auto forEachCandidate = [&](GLuint v, const auto& function) {
+      const glm::vec3& position = vertices[v];
+      const glm::i64vec3 cell = getCell( position, cell_size );
+      glm::i64vec3 side;
+      for (int k = 0; k < 3; ++k) {
+         side[k] = position[k] - static_cast<float>(cell[k]) * cell_size < epsilon ? -1 : 1;
+      }
+      for (int n = 0; n < 8; ++n) {
+         const glm::i64vec3 neighbor(
+            cell.x + ((n & 1) ? side.x : 0),
+            cell.y + ((n & 2) ? side.y : 0),
+            cell.z + ((n & 4) ? side.z : 0)
+         );
+         const uint64_t key = getCellHash( neighbor );
+         size_t slot = key & mask;
+         while (ranges[slot].End != 0 && ranges[slot].Key != key) slot = (slot + 1) & mask;
+         if (ranges[slot].End == 0) continue;
+
+         for (GLuint i = ranges[slot].Begin; i < ranges[slot].End; ++i) {
+            const GLuint u = cells[i].Value;
+            if (first_uses[u] >= first_uses[v]) continue;
+
+            const glm::vec3 d = vertices[u] - position;
+            if (glm::dot( d, d ) > squared_epsilon) continue;
+
+            // Different cells can share a hash, so make sure u is not found twice.
+            if (getCell( vertices[u], cell_size ) != neighbor) continue;
+            function( u );
+         }
+      }
+   };
+
+   std::vector<size_t> offsets(used_num + 1, 0);
+   pool.run(
+      task_num, [&](int t) {
+         const size_t end = getTaskBegin( used_num, t + 1, task_num );
+         for (size_t i = getTaskBegin( used_num, t, task_num ); i < end; ++i) {
+            forEachCandidate( used_vertices[i], [&](GLuint) { offsets[i + 1]++; } );
+         }
+      }
+   );
+   for (size_t i = 0; i < used_num; ++i) offsets[i + 1] += offsets[i];
+
+   std::vector<GLuint> candidates(offsets[used_num]);
+   pool.run(
+      task_num, [&](int t) {
+         const size_t end = getTaskBegin( used_num, t + 1, task_num );
+         for (size_t i = getTaskBegin( used_num, t, task_num ); i < end; ++i) {
+            size_t n = offsets[i];
+            forEachCandidate( used_vertices[i], [&](GLuint u) { candidates[n++] = u; } );
+            std::sort(
+               candidates.begin() + static_cast<std::ptrdiff_t>(offsets[i]),
+               candidates.begin() + static_cast<std::ptrdiff_t>(offsets[i + 1]),
+               [&](GLuint a, GLuint b) { return first_uses[a] < first_uses[b]; }
+            );
+         }
+      }
+   );
+
+   // In the order of the first use, a vertex is welded to the earliest candidate which is not welded itself.
+   // This chain is sequential, but it only visits the candidates found above.
+   size_t welded_num = 0;
+   std::vector<GLuint> welded_vertices(vertices.size(), NoIndex);
+   for (size_t i = 0; i < used_num; ++i) {
+      const GLuint v = used_vertices[i];
+      welded_vertices[v] = v;
+      for (size_t c = offsets[i]; c < offsets[i + 1]; ++c) {
+         if (welded_vertices[candidates[c]] == candidates[c]) {
+            welded_vertices[v] = candidates[c];
+            welded_num++;
+            break;
+         }
+      }
+   }
+
+   remapIndices( welded_indices, indices, welded_vertices, pool );
+   return welded_num;
+}
+
+size_t MeshOptimizer::getOpenEdgeNum(const std::vector<GLuint>& adjacency_indices)
+{
+   size_t open_edge_num = 0;
+   for (size_t i = 0; i + 1 < adjacency_indices.size(); i += 2) {
+      if (adjacency_indices[i] == adjacency_indices[i + 1]) open_edge_num++;
+   }
+   return open_edge_num;
+}
+
+void MeshOptimizer::sortKeys(std::vector<SortKey>& keys, int key_bits, ThreadPool& pool)
+{
+   // The least significant digit radix sort, which is stable, so entries of the same key keep their order.
+   constexpr int digit_bits = 11;
+   constexpr int bucket_num = 1 << digit_bits;
+   const size_t size = keys.size();
+   const int task_num = getTaskNum( size, pool );
+   std::vector<SortKey> sorted(size);
+   std::vector<std::array<size_t, bucket_num>> offsets(task_num);
+   for (int shift = 0; shift < key_bits; shift += digit_bits) {
+      pool.run(
+         task_num, [&](int t) {
+            offsets[t].fill( 0 );
+            const size_t end = getTaskBegin( size, t + 1, task_num );
+            for (size_t i = getTaskBegin( size, t, task_num ); i < end; ++i) {
+               offsets[t][(keys[i].Key >> shift) & (bucket_num - 1)]++;
+            }
+         }
+      );
+
+      size_t sum = 0;
+      bool sorted_already = false;
+      for (int d = 0; d < bucket_num; ++d) {
+         size_t bucket_size = 0;
+         for (int t = 0; t < task_num; ++t) {
+            const size_t count = offsets[t][d];
+            offsets[t][d] = sum + bucket_size;
+            bucket_size += count;
+         }
+         if (bucket_size == size) sorted_already = true;
+         sum += bucket_size;
+      }
+      if (sorted_already) continue;
+
+      pool.run(
+         task_num, [&](int t) {
+            const size_t end = getTaskBegin( size, t + 1, task_num );
+            for (size_t i = getTaskBegin( size, t, task_num ); i < end; ++i) {
+               sorted[offsets[t][(keys[i].Key >> shift) & (bucket_num - 1)]++] = keys[i];
+            }
+         }
+      );
+      std::swap( keys, sorted );
+   }
+}
+
+void MeshOptimizer::getTrianglesAdjacency(
+   std::vector<GLuint>& adjacency_indices,
+   const std::vector<GLuint>& triangle_indices,
+   size_t vertex_num,
+   ThreadPool& pool
+)
+{
+   assert( triangle_indices.size() % 3 == 0 );
+
+   const size_t face_num = triangle_indices.size() / 3;
+   const size_t edge_num = face_num * 3;
+   int vertex_bits = 1;
+   while (vertex_bits < 32 && (static_cast<size_t>(1) << vertex_bits) < vertex_num) vertex_bits++;
+
+   // An edge key is (smaller vertex << bits) | larger vertex, and its value is 3 * face + edge,
+   // where the edges of a face are (0, 1), (1, 2) and (0, 2).
+   std::vector<SortKey> edges(edge_num);
+   const int face_task_num = getTaskNum( face_num, pool );
+   pool.run(
+      face_task_num, [&](int t) {
+         const size_t end = getTaskBegin( face_num, t + 1, face_task_num );
+         for (size_t f = getTaskBegin( face_num, t, face_task_num ); f < end; ++f) {
+            const GLuint* face = &triangle_indices[f * 3];
+            const std::array<std::pair<GLuint, GLuint>, 3> face_edges = {
+               std::make_pair( face[0], face[1] ),
+               std::make_pair( face[1], face[2] ),
+               std::make_pair( face[0], face[2] )
+            };
+            for (int j = 0; j < 3; ++j) {
+               const auto [a, b] = face_edges[j];
+               edges[f * 3 + j].Key = static_cast<uint64_t>(std::min( a, b )) << vertex_bits | std::max( a, b );
+               edges[f * 3 + j].Value = static_cast<GLuint>(f * 3 + j);
+            }
+         }
+      }
+   );
+   sortKeys( edges, vertex_bits * 2, pool );
+
+   // Each run of equal keys is resolved by the task where it starts.
+   std::vector<GLuint> adjacent_faces(edge_num);
+   const int edge_task_num = getTaskNum( edge_num, pool );
+   pool.run(
+      edge_task_num, [&](int t) {
+         const size_t end = getTaskBegin( edge_num, t + 1, edge_task_num );
+         size_t i = getTaskBegin( edge_num, t, edge_task_num );
+         while (i > 0 && i < end && edges[i].Key == edges[i - 1].Key) i++;
+         while (i < end) {
+            size_t j = i + 1;
+            while (j < edge_num && edges[j].Key == edges[i].Key) j++;
+
+            const GLuint first = edges[i].Value / 3;
+            const GLuint last = j - i > 1 ? edges[j - 1].Value / 3 : NoIndex;
+            for (size_t k = i; k < j; ++k) {
+               const GLuint face = edges[k].Value / 3;
+               adjacent_faces[edges[k].Value] = first == face ? last : first;
+            }
+            i = j;
+         }
+      }
+   );
+
+   // A degenerate adjacent face may have no vertex off the edge, and then the edge is left out.
+   adjacency_indices.resize( face_num * 6 );
+   std::vector<uint8_t> index_nums(face_num);
+   std::atomic<bool> incomplete_face_found( false );
+   pool.run(
+      face_task_num, [&](int t) {
+         const size_t end = getTaskBegin( face_num, t + 1, face_task_num );
+         for (size_t f = getTaskBegin( face_num, t, face_task_num ); f < end; ++f) {
+            const GLuint* face = &triangle_indices[f * 3];
+            GLuint* output = &adjacency_indices[f * 6];
+            int n = 0;
+            for (int j = 0; j < 3; ++j) {
+               const GLuint f0 = face[j];
+               const GLuint f1 = face[(j + 1) % 3];
+               const GLuint adjacent_face = adjacent_faces[f * 3 + j];
+               if (adjacent_face == NoIndex) {
+                  output[n++] = f0;
+                  output[n++] = f0;
+                  continue;
+               }
+               for (int k = 0; k < 3; ++k) {
+                  const GLuint v = triangle_indices[adjacent_face * 3 + k];
+                  if (v != f0 && v != f1) {
+                     output[n++] = f0;
+                     output[n++] = v;
+                     break;
+                  }
+               }
+            }
+            index_nums[f] = static_cast<uint8_t>(n);
+            if (n < 6) incomplete_face_found.store( true, std::memory_order_relaxed );
+         }
+      }
+   );
+
+   if (incomplete_face_found) {
+      size_t n = 0;
+      for (size_t f = 0; f < face_num; ++f) {
+         for (int k = 0; k < index_nums[f]; ++k) adjacency_indices[n++] = adjacency_indices[f * 6 + k];
+      }
+      adjacency_indices.resize( n );
+   }
+}
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include "obj_parser.h"
+
+const char* ObjParser::parseFloat(float& value, const char* ptr, const char* end)
+{
+   ptr = skipSpaces( ptr, end );
+   if (ptr < end && *ptr == '+') ++ptr;
+   const std::from_chars_result result = std::from_chars( ptr, end, value );
+   if (result.ec != std::errc()) value = 0.0f;
+   return result.ptr;
+}
+
+const char* ObjParser::parseIndex(
+   int& index,
+   int& overrun,
+   ObjData& data,
+   int element_num,
+   const char* ptr,
+   const char* end
+)
+{
+   int value = 0;
+   const std::from_chars_result result = std::from_chars( ptr, end, value );
+   if (result.ec != std::errc() || value == 0) {
+      index = -1;
+      return result.ptr;
+   }
+
+   // OBJ indices are 1-based, and negative ones are relative to the elements read so far.
+   if (value < 0) {
+      data.HasRelativeIndices = true;
+      index = element_num + value;
+      return result.ptr;
+   }
+
+   // A chunk cannot see the elements of the preceding chunks, so its indices are checked after parsing.
+   if (value > element_num && !data.IsChunk) {
+      index = -1;
+      return result.ptr;
+   }
+   index = value - 1;
+   overrun = std::max( overrun, value - element_num );
+   return result.ptr;
+}
+
+const char* ObjParser::parseFaceVertex(
+   FaceVertex& face_vertex,
+   ObjData& data,
+   const char* ptr,
+   const char* end
+)
+{
+   // one of v, v/t, v//n and v/t/n
+   face_vertex = FaceVertex();
+   ptr = parseIndex( face_vertex.Vertex, data.VertexOverrun, data, static_cast<int>(data.Vertices.size()), ptr, end );
+   if (ptr < end && *ptr == '/') {
+      ++ptr;
+      if (ptr < end && *ptr != '/') {
+         ptr = parseIndex(
+            face_vertex.Texture, data.TextureOverrun, data, static_cast<int>(data.Textures.size()), ptr, end
+         );
+      }
+      if (ptr < end && *ptr == '/') {
+         ++ptr;
+         ptr = parseIndex(
+            face_vertex.Normal, data.NormalOverrun, data, static_cast<int>(data.Normals.size()), ptr, end
+         );
+      }
+   }
+   while (ptr < end && !isSpace( *ptr ) && *ptr != '\n') ++ptr;
+   return ptr;
+}
+
+void ObjParser::addFaceVertex(ObjData& data, const FaceVertex& face_vertex)
+{
+   data.VertexIndices.emplace_back( static_cast<GLuint>(face_vertex.Vertex) );
+   if (face_vertex.Texture >= 0) data.TextureIndices.emplace_back( static_cast<GLuint>(face_vertex.Texture) );
+   if (face_vertex.Normal >= 0) data.NormalIndices.emplace_back( static_cast<GLuint>(face_vertex.Normal) );
+}
+
+void ObjParser::parse(ObjData& data, const char* begin, const char* end)
+{
+   const char* ptr = begin;
+   while (ptr < end) {
+      ptr = skipSpaces( ptr, end );
+      if (ptr + 1 >= end) break;
+
+      if (ptr[0] == 'v' && isSpace( ptr[1] )) {
+         glm::vec3 vertex;
+         ptr = parseFloat( vertex.x, ptr + 1, end );
+         ptr = parseFloat( vertex.y, ptr, end );
+         ptr = parseFloat( vertex.z, ptr, end );
+         data.Vertices.emplace_back( vertex );
+      }
+      else if (ptr[0] == 'v' && ptr[1] == 't' && ptr + 2 < end && isSpace( ptr[2] )) {
+         glm::vec2 uv;
+         ptr = parseFloat( uv.x, ptr + 2, end );
+         ptr = parseFloat( uv.y, ptr, end );
+         data.Textures.emplace_back( uv );
+      }
+      else if (ptr[0] == 'v' && ptr[1] == 'n' && ptr + 2 < end && isSpace( ptr[2] )) {
+         glm::vec3 normal;
+         ptr = parseFloat( normal.x, ptr + 2, end );
+         ptr = parseFloat( normal.y, ptr, end );
+         ptr = parseFloat( normal.z, ptr, end );
+         data.Normals.emplace_back( normal );
+      }
+      else if (ptr[0] == 'f' && isSpace( ptr[1] )) {
+         int corner_num = 0;
+         FaceVertex first, previous, current;
+         ptr = skipSpaces( ptr + 1, end );
+         while (ptr < end && *ptr != '\n') {
+            ptr = parseFaceVertex( current, data, ptr, end );
+            if (current.Vertex >= 0) {
+               if (corner_num == 0) first = current;
+               else if (corner_num >= 2) {
+                  addFaceVertex( data, first );
+                  addFaceVertex( data, previous );
+                  addFaceVertex( data, current );
+               }
+               previous = current;
+               corner_num++;
+            }
+            ptr = skipSpaces( ptr, end );
+         }
+      }
+      ptr = skipLine( ptr, end );
+   }
+}
+
+void ObjParser::parseInParallel(ObjData& data, const char* begin, const char* end, ThreadPool& pool)
+{
+   const auto size = static_cast<size_t>(end - begin);
+   const size_t chunk_num = std::min( static_cast<size_t>(pool.getThreadNum()) * 4, size / MinChunkSize );
+   if (chunk_num <= 1) {
+      parse( data, begin, end );
+      return;
+   }
+
+   std::vector<const char*> boundaries(chunk_num + 1, end);
+   boundaries[0] = begin;
+   for (size_t i = 1; i < chunk_num; ++i) {
+      const char* ptr = std::max( begin + size * i / chunk_num, boundaries[i - 1] );
+      boundaries[i] = ptr == begin ? begin : skipLine( ptr - 1, end );
+   }
+
+   std::vector<ObjData> chunks(chunk_num);
+   pool.run(
+      static_cast<int>(chunk_num), [&](int i) {
+         chunks[i].IsChunk = true;
+         parse( chunks[i], boundaries[i], boundaries[i + 1] );
+      }
+   );
+
+   // Relative indices depend on the elements of the preceding chunks, which a chunk cannot see.
+   // A positive index reaching beyond the elements of the preceding chunks is out of range, and parse() drops it.
+   size_t vertex_num = 0, normal_num = 0, texture_num = 0;
+   for (const auto& chunk : chunks) {
+      if (chunk.HasRelativeIndices ||
+          chunk.VertexOverrun > static_cast<int>(vertex_num) ||
+          chunk.NormalOverrun > static_cast<int>(normal_num) ||
+          chunk.TextureOverrun > static_cast<int>(texture_num)) {
+         data = ObjData();
+         parse( data, begin, end );
+         return;
+      }
+      vertex_num += chunk.Vertices.size();
+      normal_num += chunk.Normals.size();
+      texture_num += chunk.Textures.size();
+   }
+
+   concatenate( data.Vertices, chunks, &ObjData::Vertices, pool );
+   concatenate( data.Normals, chunks, &ObjData::Normals, pool );
+   concatenate( data.Textures, chunks, &ObjData::Textures, pool );
+   concatenate( data.VertexIndices, chunks, &ObjData::VertexIndices, pool );
+   concatenate( data.NormalIndices, chunks, &ObjData::NormalIndices, pool );
+   concatenate( data.TextureIndices, chunks, &ObjData::TextureIndices, pool );
+}
\ No newline at end of file
@@ -1,7 +1,11 @@
 #include "object.h"
 
 ObjectGL::ObjectGL() :
-   AdjacencyMode( false ), VAO( 0 ), VBO( 0 ), IBO( 0 ), DrawMode( 0 ), VerticesCount( 0 ),
+   AdjacencyMode( false ), ParallelLoading( true ), UseMeshCache( true ), OptimizeMesh( false ),
+   CompactVertexRequested( false ), UseCompactVertexFormat( false ), UsePositionStream( false ), WeldingEpsilon( 0.0f ),
+   VAO( 0 ), VBO( 0 ), IBO( 0 ), PositionVAO( 0 ),
+   PositionVBO( 0 ), PositionStride( 0 ), InstanceBuffer( 0 ), InstanceVersion( 0 ), DrawMode( 0 ), VerticesCount( 0 ),
+   BoundingBoxMin( 0.0f ), BoundingBoxMax( 0.0f ), DequantizationMatrix( 1.0f ),
    EmissionColor( 0.0f, 0.0f, 0.0f, 1.0f ), AmbientReflectionColor( 0.2f, 0.2f, 0.2f, 1.0f ),
    DiffuseReflectionColor( 0.8f, 0.8f, 0.8f, 1.0f ), SpecularReflectionColor( 0.0f, 0.0f, 0.0f, 1.0f ),
    SpecularReflectionExponent( 0.0f )
@@ -13,6 +17,9 @@ ObjectGL::~ObjectGL()
    if (IBO != 0) glDeleteBuffers( 1, &IBO );
    if (VBO != 0) glDeleteBuffers( 1, &VBO );
    if (VAO != 0) glDeleteVertexArrays( 1, &VAO );
+   if (PositionVBO != 0) glDeleteBuffers( 1, &PositionVBO );
+   if (PositionVAO != 0) glDeleteVertexArrays( 1, &PositionVAO );
+   if (InstanceBuffer != 0) glDeleteBuffers( 1, &InstanceBuffer );
    for (const auto& texture_id : TextureID) {
       if (texture_id != 0) glDeleteTextures( 1, &texture_id );
    }
@@ -21,6 +28,55 @@ ObjectGL::~ObjectGL()
    }
 }
 
+void ObjectGL::setParallelLoading(bool parallel_loading)
+{
+   ParallelLoading = parallel_loading;
+}
+
+void ObjectGL::setMeshCacheUsage(bool use_mesh_cache)
+{
+   UseMeshCache = use_mesh_cache;
+}
+
+void ObjectGL::setMeshOptimization(bool optimize_mesh)
+{
+   OptimizeMesh = optimize_mesh;
+}
+
+void ObjectGL::setCompactVertexFormat(bool use_compact_vertex_format)
+{
+   CompactVertexRequested = use_compact_vertex_format;
+}
+
+void ObjectGL::setPositionStream(bool use_position_stream)
+{
+   UsePositionStream = use_position_stream;
+}
+
+void ObjectGL::setWeldingEpsilon(float welding_epsilon)
+{
+   WeldingEpsilon = std::max( welding_epsilon, 0.0f );
+}
+
+void ObjectGL::setInstanceTransforms(const std::vector<glm::mat4>& transforms)
+{
+   // The storage is immutable, so it is created again only when the number of instances changes.
+   if (InstanceBuffer != 0 && transforms.size() != InstanceTransforms.size()) {
+      glDeleteBuffers( 1, &InstanceBuffer );
+      InstanceBuffer = 0;
+   }
+   InstanceTransforms = transforms;
+   InstanceVersion++;
+   if (InstanceTransforms.empty()) return;
+
+   const auto size = static_cast<GLsizeiptr>(sizeof( glm::mat4 ) * InstanceTransforms.size());
+   if (InstanceBuffer == 0) {
+      glCreateBuffers( 1, &InstanceBuffer );
+      glNamedBufferStorage( InstanceBuffer, size, InstanceTransforms.data(), GL_DYNAMIC_STORAGE_BIT );
+   }
+   else glNamedBufferSubData( InstanceBuffer, 0, size, InstanceTransforms.data() );
+}
+
 void ObjectGL::setEmissionColor(const glm::vec4& emission_color)
 {
    EmissionColor = emission_color;
@@ -125,40 +181,94 @@ int ObjectGL::addTexture(const uint8_t* image_buffer, int width, int height, boo
 
 void ObjectGL::prepareTexture(bool normals_exist) const
 {
-   const uint offset = normals_exist ? 6 : 3;
-   glVertexArrayAttribFormat( VAO, TextureLoc, 2, GL_FLOAT, GL_FALSE, offset * sizeof( GLfloat ) );
+   if (UseCompactVertexFormat) {
+      const uint offset = normals_exist ? 12 : 8;
+      glVertexArrayAttribFormat( VAO, TextureLoc, 2, GL_HALF_FLOAT, GL_FALSE, offset );
+   }
+   else {
+      const uint offset = normals_exist ? 6 : 3;
+      glVertexArrayAttribFormat( VAO, TextureLoc, 2, GL_FLOAT, GL_FALSE, offset * sizeof( GLfloat ) );
+   }
    glEnableVertexArrayAttrib( VAO, TextureLoc );
    glVertexArrayAttribBinding( VAO, TextureLoc, 0 );
 }
 
 void ObjectGL::prepareNormal() const
 {
-   glVertexArrayAttribFormat( VAO, NormalLoc, 3, GL_FLOAT, GL_FALSE, 3 * sizeof( GLfloat ) );
+   if (UseCompactVertexFormat) glVertexArrayAttribFormat( VAO, NormalLoc, 2, GL_SHORT, GL_TRUE, 8 );
+   else glVertexArrayAttribFormat( VAO, NormalLoc, 3, GL_FLOAT, GL_FALSE, 3 * sizeof( GLfloat ) );
    glEnableVertexArrayAttrib( VAO, NormalLoc );
    glVertexArrayAttribBinding( VAO, NormalLoc, 0 );
 }
 
-void ObjectGL::prepareVertexBuffer(int n_bytes_per_vertex)
+void ObjectGL::prepareVertexBuffer(int n_bytes_per_vertex, bool compact_vertex)
 {
+   prepareVertexBuffer( n_bytes_per_vertex, DataBuffer.data(), sizeof( GLfloat ) * DataBuffer.size(), compact_vertex );
+}
+
+void ObjectGL::prepareVertexBuffer(int n_bytes_per_vertex, const GLvoid* data, GLsizeiptr size, bool compact_vertex)
+{
+   // The attribute formats of the normals, textures and position stream follow the format of this buffer.
+   UseCompactVertexFormat = compact_vertex;
    glCreateBuffers( 1, &VBO );
-   glNamedBufferStorage( VBO, sizeof( GLfloat ) * DataBuffer.size(), DataBuffer.data(), GL_DYNAMIC_STORAGE_BIT );
+   glNamedBufferStorage( VBO, size, data, GL_DYNAMIC_STORAGE_BIT );
 
    glCreateVertexArrays( 1, &VAO );
    glVertexArrayVertexBuffer( VAO, 0, VBO, 0, n_bytes_per_vertex );
-   glVertexArrayAttribFormat( VAO, VertexLoc, 3, GL_FLOAT, GL_FALSE, 0 );
+   if (UseCompactVertexFormat) glVertexArrayAttribFormat( VAO, VertexLoc, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0 );
+   else glVertexArrayAttribFormat( VAO, VertexLoc, 3, GL_FLOAT, GL_FALSE, 0 );
    glEnableVertexArrayAttrib( VAO, VertexLoc );
    glVertexArrayAttribBinding( VAO, VertexLoc, 0 );
+   PositionStride = n_bytes_per_vertex;
+
+   if (UsePositionStream) preparePositionBuffer( n_bytes_per_vertex, data, size );
+}
+
+void ObjectGL::preparePositionBuffer(int n_bytes_per_vertex, const GLvoid* data, GLsizeiptr size)
+{
+   // The position is always the first attribute, so the stream is the leading bytes of every vertex.
+   // The compact format keeps its 16-bit padding to stay 4-byte aligned.
+   const int n_bytes_per_position = UseCompactVertexFormat ? 4 * sizeof( uint16_t ) : 3 * sizeof( GLfloat );
+   const auto vertex_num = static_cast<size_t>(size / n_bytes_per_vertex);
+   std::vector<uint8_t> positions(vertex_num * n_bytes_per_position);
+   PositionStride = n_bytes_per_position;
+   const auto* vertex = static_cast<const uint8_t*>(data);
+   for (size_t i = 0; i < vertex_num; ++i) {
+      std::memcpy( positions.data() + i * n_bytes_per_position, vertex + i * n_bytes_per_vertex, n_bytes_per_position );
+   }
+
+   if (PositionVBO != 0) {
+      glNamedBufferSubData( PositionVBO, 0, static_cast<GLsizeiptr>(positions.size()), positions.data() );
+      return;
+   }
+
+   glCreateBuffers( 1, &PositionVBO );
+   glNamedBufferStorage( PositionVBO, static_cast<GLsizeiptr>(positions.size()), positions.data(), GL_DYNAMIC_STORAGE_BIT );
+
+   glCreateVertexArrays( 1, &PositionVAO );
+   glVertexArrayVertexBuffer( PositionVAO, 0, PositionVBO, 0, n_bytes_per_position );
+   if (UseCompactVertexFormat) glVertexArrayAttribFormat( PositionVAO, VertexLoc, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0 );
+   else glVertexArrayAttribFormat( PositionVAO, VertexLoc, 3, GL_FLOAT, GL_FALSE, 0 );
+   glEnableVertexArrayAttrib( PositionVAO, VertexLoc );
+   glVertexArrayAttribBinding( PositionVAO, VertexLoc, 0 );
+   if (IBO != 0) glVertexArrayElementBuffer( PositionVAO, IBO );
 }
 
 void ObjectGL::prepareIndexBuffer()
+{
+   prepareIndexBuffer( IndexBuffer.data(), sizeof( GLuint ) * IndexBuffer.size() );
+}
+
+void ObjectGL::prepareIndexBuffer(const GLvoid* data, GLsizeiptr size)
 {
    assert( VAO != 0 );
 
    if (IBO != 0) glDeleteBuffers( 1, &IBO );
 
    glCreateBuffers( 1, &IBO );
-   glNamedBufferStorage( IBO, sizeof( GLuint ) * IndexBuffer.size(), IndexBuffer.data(), GL_DYNAMIC_STORAGE_BIT );
+   glNamedBufferStorage( IBO, size, data, GL_DYNAMIC_STORAGE_BIT );
    glVertexArrayElementBuffer( VAO, IBO );
+   if (PositionVAO != 0) glVertexArrayElementBuffer( PositionVAO, IBO );
 }
 
 void ObjectGL::getSquareObject(
@@ -207,6 +317,7 @@ void ObjectGL::setObject(GLenum draw_mode, const std::vector<glm::vec3>& vertice
       DataBuffer.push_back( vertex.z );
       VerticesCount++;
    }
+   findBoundingBox( vertices );
    const int n_bytes_per_vertex = 3 * sizeof( GLfloat );
    prepareVertexBuffer( n_bytes_per_vertex );
 }
@@ -229,11 +340,24 @@ void ObjectGL::setObject(
       DataBuffer.push_back( normals[i].z );
       VerticesCount++;
    }
+   findBoundingBox( vertices );
    const int n_bytes_per_vertex = 6 * sizeof( GLfloat );
    prepareVertexBuffer( n_bytes_per_vertex );
    prepareNormal();
 }
 
+void ObjectGL::setObject(
+   GLenum draw_mode,
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<glm::vec3>& normals,
+   const std::vector<GLuint>& indices
+)
+{
+   setObject( draw_mode, vertices, normals );
+   IndexBuffer = indices;
+   prepareIndexBuffer();
+}
+
 void ObjectGL::setObject(
    GLenum draw_mode,
    const std::vector<glm::vec3>& vertices,
@@ -253,6 +377,7 @@ void ObjectGL::setObject(
       DataBuffer.push_back( textures[i].y );
       VerticesCount++;
    }
+   findBoundingBox( vertices );
    const int n_bytes_per_vertex = 5 * sizeof( GLfloat );
    prepareVertexBuffer( n_bytes_per_vertex );
    prepareTexture( false );
@@ -280,6 +405,7 @@ void ObjectGL::setObject(
       DataBuffer.push_back( textures[i].y );
       VerticesCount++;
    }
+   findBoundingBox( vertices );
    const int n_bytes_per_vertex = 8 * sizeof( GLfloat );
    prepareVertexBuffer( n_bytes_per_vertex );
    prepareNormal();
@@ -305,7 +431,7 @@ void ObjectGL::findNormals(
    const std::vector<GLuint>& vertex_indices
 )
 {
-   normals.resize( vertices.size(), glm::vec3(0.0f) );
+   normals.assign( vertices.size(), glm::vec3(0.0f) );
    const auto size = static_cast<int>(vertex_indices.size());
    for (int i = 0; i < size; i += 3) {
       const GLuint n0 = vertex_indices[i];
@@ -319,73 +445,78 @@ void ObjectGL::findNormals(
    for (auto& n : normals) n = glm::normalize( n );
 }
 
-void ObjectGL::findAdjacency(const std::vector<glm::vec3>& vertices, const std::vector<GLuint>& indices)
+void ObjectGL::getPositions(std::vector<glm::vec3>& positions) const
 {
-   const auto size = static_cast<int>(indices.size());
-
-   assert( size % 3 == 0 );
+   positions.resize( VerticesCount );
+   if (VerticesCount == 0) return;
 
-   std::vector<std::array<GLuint, 3>> unique_faces;
-   std::map<glm::vec3, GLuint, VectorComparison> vertex_to_index;
-   std::map<std::pair<GLuint, GLuint>, std::pair<GLuint, GLuint>> edge_to_adjacent_faces;
-   for (int i = 0; i < size; i += 3) {
-      std::array<GLuint, 3> face{};
-      for (int j = 0; j < 3; ++j) {
-         GLuint index = indices[i + j];
-         const glm::vec3 v = vertices[index];
-         if (vertex_to_index.find( v ) != vertex_to_index.end()) index = vertex_to_index[v];
-         else vertex_to_index[v] = index;
-         face[j] = index;
-      }
-      unique_faces.emplace_back( face );
-
-      const GLuint face_index = i / 3;
-      const auto edge0 = std::make_pair( std::min( face[0], face[1] ), std::max( face[0], face[1] ) );
-      const auto edge1 = std::make_pair( std::min( face[1], face[2] ), std::max( face[1], face[2] ) );
-      const auto edge2 = std::make_pair( std::min( face[0], face[2] ), std::max( face[0], face[2] ) );
-      if (edge_to_adjacent_faces.find( edge0 ) != edge_to_adjacent_faces.end()) {
-         edge_to_adjacent_faces[edge0].second = face_index;
-      }
-      else edge_to_adjacent_faces[edge0] = std::make_pair( face_index, -1 );
-      if (edge_to_adjacent_faces.find( edge1 ) != edge_to_adjacent_faces.end()) {
-         edge_to_adjacent_faces[edge1].second = face_index;
-      }
-      else edge_to_adjacent_faces[edge1] = std::make_pair( face_index, -1 );
-      if (edge_to_adjacent_faces.find( edge2 ) != edge_to_adjacent_faces.end()) {
-         edge_to_adjacent_faces[edge2].second = face_index;
-      }
-      else edge_to_adjacent_faces[edge2] = std::make_pair( face_index, -1 );
-   }
-
-   const auto unique_face_size = static_cast<int>(unique_faces.size());
-   IndexBuffer.reserve( unique_face_size * 6 );
-   for (int i = 0; i < unique_face_size; ++i) {
-      for (int j = 0; j < 3; ++j) {
-         const GLuint f0 = unique_faces[i][j];
-         const GLuint f1 = unique_faces[i][(j + 1) % 3];
-         const auto edge = std::make_pair( std::min( f0, f1 ), std::max( f0, f1 ) );
-
-         assert( edge_to_adjacent_faces.find( edge ) != edge_to_adjacent_faces.end() );
-
-         const std::pair<GLuint, GLuint> faces = edge_to_adjacent_faces[edge];
-         const GLuint adjacent_face_index = faces.first == i ? faces.second : faces.first;
-         if (adjacent_face_index != -1) {
-            for (const auto& f : unique_faces[adjacent_face_index]) {
-               if (f != edge.first && f != edge.second) {
-                  IndexBuffer.emplace_back( f0 );
-                  IndexBuffer.emplace_back( f );
-                  break;
-               }
-            }
-         }
-         else {
-            IndexBuffer.emplace_back( f0 );
-            IndexBuffer.emplace_back( f0 );
-         }
+   const size_t stride = DataBuffer.size() / VerticesCount;
+   for (size_t i = 0; i < positions.size(); ++i) {
+      const GLfloat* vertex = &DataBuffer[i * stride];
+      if (UseCompactVertexFormat) {
+         std::array<uint16_t, 4> position{};
+         std::memcpy( position.data(), vertex, sizeof( position ) );
+         const glm::vec4 normalized(glm::vec3(position[0], position[1], position[2]) / 65535.0f, 1.0f);
+         positions[i] = glm::vec3(DequantizationMatrix * normalized);
       }
+      else positions[i] = glm::vec3(vertex[0], vertex[1], vertex[2]);
    }
 }
 
+void ObjectGL::findBoundingBox(const std::vector<glm::vec3>& vertices)
+{
+   BoundingBoxMin = glm::vec3(std::numeric_limits<float>::max());
+   BoundingBoxMax = glm::vec3(std::numeric_limits<float>::lowest());
+   for (const auto& vertex : vertices) {
+      BoundingBoxMin = glm::min( BoundingBoxMin, vertex );
+      BoundingBoxMax = glm::max( BoundingBoxMax, vertex );
+   }
+}
+
+void ObjectGL::findAdjacency(const std::vector<glm::vec3>& vertices, const std::vector<GLuint>& indices)
+{
+   assert( indices.size() % 3 == 0 );
+
+   ThreadPool& pool = ThreadPool::getInstance();
+   std::vector<GLuint> welded_indices;
+   MeshOptimizer::weldVertices( welded_indices, vertices, indices, pool );
+   MeshOptimizer::getTrianglesAdjacency( IndexBuffer, welded_indices, vertices.size(), pool );
+   if (WeldingEpsilon <= 0.0f) return;
+
+   // Noisy scans have cracks of nearly coincident vertices, whose edges would be open and so always silhouettes.
+   const size_t open_edge_num = MeshOptimizer::getOpenEdgeNum( IndexBuffer );
+   const size_t welded_num = MeshOptimizer::weldVerticesWithTolerance( welded_indices, vertices, indices, WeldingEpsilon, pool );
+   MeshOptimizer::getTrianglesAdjacency( IndexBuffer, welded_indices, vertices.size(), pool );
+
+   std::stringstream report;
+   report << "Vertex welding: " << welded_num << " vertices welded within " << WeldingEpsilon << ", open edges "
+      << open_edge_num << " -> " << MeshOptimizer::getOpenEdgeNum( IndexBuffer ) << "\n";
+   std::cout << report.str();
+}
+
+void ObjectGL::optimizeMesh(
+   std::vector<glm::vec3>& vertices,
+   std::vector<glm::vec3>& normals,
+   std::vector<glm::vec2>& textures
+)
+{
+   const int primitive_size = AdjacencyMode ? 6 : 3;
+   const float acmr_before = MeshOptimizer::getACMR( IndexBuffer, primitive_size );
+   MeshOptimizer::reorderPrimitives( IndexBuffer, vertices.size(), primitive_size );
+
+   std::vector<GLuint> remap;
+   MeshOptimizer::reorderVertices( remap, IndexBuffer, vertices.size() );
+   MeshOptimizer::remapVertices( vertices, remap );
+   if (normals.size() == remap.size()) MeshOptimizer::remapVertices( normals, remap );
+   if (textures.size() == remap.size()) MeshOptimizer::remapVertices( textures, remap );
+
+   const float acmr_after = MeshOptimizer::getACMR( IndexBuffer, primitive_size );
+   std::stringstream report;
+   report << "Mesh optimization: ACMR " << std::fixed << std::setprecision( 3 ) << acmr_before << " -> " << acmr_after
+      << " (cache size " << MeshOptimizer::DefaultCacheSize << ")\n";
+   std::cout << report.str();
+}
+
 bool ObjectGL::readObjectFile(
    std::vector<glm::vec3>& vertices,
    std::vector<glm::vec3>& normals,
@@ -393,104 +524,337 @@ bool ObjectGL::readObjectFile(
    const std::string& file_path
 )
 {
-   std::ifstream file(file_path);
-   if (!file.is_open()) {
+   const MappedFile file(file_path);
+   if (!file.isOpen()) {
       std::cout << "The object file is not correct.\n";
       return false;
    }
 
-   bool found_normals = false, found_textures = false;
-   std::vector<glm::vec3> vertex_buffer, normal_buffer;
-   std::vector<glm::vec2> texture_buffer;
-   std::vector<GLuint> vertex_indices, normal_indices, texture_indices;
-   while (!file.eof()) {
-      std::string word;
-      file >> word;
-
-      if (word == "v") {
-         glm::vec3 vertex;
-         file >> vertex.x >> vertex.y >> vertex.z;
-         vertex_buffer.emplace_back( vertex );
-      }
-      else if (word == "vt") {
-         glm::vec2 uv;
-         file >> uv.x >> uv.y;
-         texture_buffer.emplace_back( uv );
-         found_textures = true;
-      }
-      else if (word == "vn") {
-         glm::vec3 normal;
-         file >> normal.x >> normal.y >> normal.z;
-         normal_buffer.emplace_back( normal );
-         found_normals = true;
-      }
-      else if (word == "f") {
-         std::string face;
-         const std::regex delimiter("[/]");
-         for (int i = 0; i < 3; ++i) {
-            file >> face;
-            const std::sregex_token_iterator it(face.begin(), face.end(), delimiter, -1);
-            const std::vector<std::string> vtn(it, std::sregex_token_iterator());
-            vertex_indices.emplace_back( std::stoi( vtn[0] ) - 1 );
-            if (found_textures) texture_indices.emplace_back( std::stoi( vtn[1] ) - 1 );
-            if (found_normals) normal_indices.emplace_back( std::stoi( vtn[2] ) - 1 );
-         }
-      }
-      else std::getline( file, word );
+   ObjParser::ObjData obj;
+   if (ParallelLoading) {
+      ObjParser::parseInParallel( obj, file.getData(), file.getData() + file.getSize(), ThreadPool::getInstance() );
    }
+   else ObjParser::parse( obj, file.getData(), file.getData() + file.getSize() );
 
-   if (!found_normals) findNormals( normal_buffer, vertex_buffer, vertex_indices );
+   // Indices of a kind are used only when every face vertex has one.
+   const bool found_normals = !obj.Normals.empty() && obj.NormalIndices.size() == obj.VertexIndices.size();
+   const bool found_textures = !obj.Textures.empty() && obj.TextureIndices.size() == obj.VertexIndices.size();
+   if (!found_normals) findNormals( obj.Normals, obj.Vertices, obj.VertexIndices );
 
    if (!AdjacencyMode) {
-      for (size_t i = 0; i < vertex_indices.size(); ++i) {
-         vertices.emplace_back( vertex_buffer[vertex_indices[i]] );
-         if (found_normals) normals.emplace_back( normal_buffer[normal_indices[i]] );
-         else normals.emplace_back( normal_buffer[vertex_indices[i]] );
-         if (found_textures) textures.emplace_back( texture_buffer[texture_indices[i]] );
+      // Every distinct (position, normal, texture) index triple becomes one vertex of the indexed mesh.
+      const size_t size = obj.VertexIndices.size();
+      std::unordered_map<VertexKey, GLuint, VertexKeyHash> key_to_index;
+      key_to_index.reserve( size );
+      IndexBuffer.clear();
+      IndexBuffer.reserve( size );
+      for (size_t i = 0; i < size; ++i) {
+         const VertexKey key{
+            obj.VertexIndices[i],
+            found_normals ? obj.NormalIndices[i] : obj.VertexIndices[i],
+            found_textures ? obj.TextureIndices[i] : 0
+         };
+         const auto [it, inserted] = key_to_index.try_emplace( key, static_cast<GLuint>(vertices.size()) );
+         if (inserted) {
+            vertices.emplace_back( obj.Vertices[key.Vertex] );
+            normals.emplace_back( obj.Normals[key.Normal] );
+            if (found_textures) textures.emplace_back( obj.Textures[key.Texture] );
+         }
+         IndexBuffer.emplace_back( it->second );
       }
    }
    else {
-      vertices = std::move( vertex_buffer );
-      normals = std::move( normal_buffer );
-      if (found_textures) textures = std::move( texture_buffer );
-      findAdjacency( vertices, vertex_indices );
+      vertices = std::move( obj.Vertices );
+      normals = std::move( obj.Normals );
+      if (found_textures) textures = std::move( obj.Textures );
+      findAdjacency( vertices, obj.VertexIndices );
    }
+   if (OptimizeMesh) optimizeMesh( vertices, normals, textures );
    return true;
 }
 
-void ObjectGL::setObject(GLenum draw_mode, const std::string& obj_file_path)
+glm::mat4 ObjectGL::getDequantizationMatrix(const glm::vec3& bounding_box_min, const glm::vec3& bounding_box_max)
 {
-   DrawMode = draw_mode;
-   AdjacencyMode = DrawMode == GL_TRIANGLES_ADJACENCY;
-   std::vector<glm::vec3> vertices, normals;
-   std::vector<glm::vec2> textures;
-   if (!readObjectFile( vertices, normals, textures, obj_file_path )) return;
+   return
+      glm::translate( glm::mat4(1.0f), bounding_box_min ) *
+      glm::scale( glm::mat4(1.0f), bounding_box_max - bounding_box_min );
+}
+
+glm::vec2 ObjectGL::encodeOctahedron(const glm::vec3& normal)
+{
+   const glm::vec3 n = normal / (std::abs( normal.x ) + std::abs( normal.y ) + std::abs( normal.z ));
+   if (n.z >= 0.0f) return { n.x, n.y };
+
+   return {
+      (1.0f - std::abs( n.y )) * (n.x >= 0.0f ? 1.0f : -1.0f),
+      (1.0f - std::abs( n.x )) * (n.y >= 0.0f ? 1.0f : -1.0f)
+   };
+}
 
+glm::vec3 ObjectGL::decodeOctahedron(const glm::vec2& encoded)
+{
+   glm::vec3 n(encoded.x, encoded.y, 1.0f - std::abs( encoded.x ) - std::abs( encoded.y ));
+   if (n.z < 0.0f) {
+      n.x = (1.0f - std::abs( encoded.y )) * (encoded.x >= 0.0f ? 1.0f : -1.0f);
+      n.y = (1.0f - std::abs( encoded.x )) * (encoded.y >= 0.0f ? 1.0f : -1.0f);
+   }
+   return glm::normalize( n );
+}
+
+bool ObjectGL::prepareCompactDataBuffer(
+   int& n_bytes_per_vertex,
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<glm::vec3>& normals,
+   const std::vector<glm::vec2>& textures
+)
+{
+   // position: 3 x 16-bit unorm relative to the bounding box (+ 16-bit padding)
+   // normal: 2 x 16-bit snorm of the octahedral encoding
+   // texture: 2 x 16-bit half float
    const bool normals_exist = !normals.empty();
    const bool textures_exist = !textures.empty();
-   for (uint i = 0; i < vertices.size(); ++i) {
-      DataBuffer.push_back( vertices[i].x );
-      DataBuffer.push_back( vertices[i].y );
-      DataBuffer.push_back( vertices[i].z );
+   const int normal_offset = 8;
+   const int texture_offset = normals_exist ? 12 : 8;
+   n_bytes_per_vertex = texture_offset + (textures_exist ? 4 : 0);
+
+   const glm::vec3 extent = BoundingBoxMax - BoundingBoxMin;
+   const glm::vec3 inverse_extent(
+      extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+      extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+      extent.z > 0.0f ? 1.0f / extent.z : 0.0f
+   );
+
+   // Each bound is the rounding error of the format plus some slack for the float arithmetic of decoding.
+   const float magnitude = std::max( glm::compMax( glm::abs( BoundingBoxMin ) ), glm::compMax( glm::abs( BoundingBoxMax ) ) );
+   const glm::vec3 position_bound = 0.5f * extent / 65535.0f + 8.0f * std::numeric_limits<float>::epsilon() * magnitude;
+   constexpr float normal_bound = 2e-3f; // in radian
+   constexpr float texture_relative_bound = 1.0f / 1024.0f;
+
+   const auto word_num = static_cast<size_t>(n_bytes_per_vertex / sizeof( GLfloat ));
+   std::vector<GLfloat> compact_buffer(vertices.size() * word_num);
+   glm::vec3 max_position_error(0.0f);
+   float max_normal_error = 0.0f, max_texture_error = 0.0f;
+   bool within_bound = true;
+   for (size_t i = 0; i < vertices.size(); ++i) {
+      auto* vertex = reinterpret_cast<uint8_t*>(compact_buffer.data() + i * word_num);
+
+      const glm::vec3 normalized = glm::clamp( (vertices[i] - BoundingBoxMin) * inverse_extent, 0.0f, 1.0f );
+      const std::array<uint16_t, 4> position = {
+         static_cast<uint16_t>(std::lround( normalized.x * 65535.0f )),
+         static_cast<uint16_t>(std::lround( normalized.y * 65535.0f )),
+         static_cast<uint16_t>(std::lround( normalized.z * 65535.0f )),
+         0
+      };
+      std::memcpy( vertex, position.data(), sizeof( position ) );
+      const glm::vec3 decoded_position =
+         BoundingBoxMin + glm::vec3(position[0], position[1], position[2]) / 65535.0f * extent;
+      const glm::vec3 position_error = glm::abs( decoded_position - vertices[i] );
+      max_position_error = glm::max( max_position_error, position_error );
+      if (glm::any( glm::greaterThan( position_error, position_bound ) )) within_bound = false;
+
       if (normals_exist) {
-         DataBuffer.push_back( normals[i].x );
-         DataBuffer.push_back( normals[i].y );
-         DataBuffer.push_back( normals[i].z );
+         // Normals of isolated vertices can be degenerate, and there is nothing to preserve in them.
+         const float length = glm::length( normals[i] );
+         const bool is_valid = std::isfinite( length ) && length > 0.0f;
+         const glm::vec2 encoded = is_valid ? encodeOctahedron( normals[i] ) : glm::vec2(0.0f);
+         const std::array<int16_t, 2> normal = {
+            static_cast<int16_t>(std::lround( glm::clamp( encoded.x, -1.0f, 1.0f ) * 32767.0f )),
+            static_cast<int16_t>(std::lround( glm::clamp( encoded.y, -1.0f, 1.0f ) * 32767.0f ))
+         };
+         std::memcpy( vertex + normal_offset, normal.data(), sizeof( normal ) );
+         if (is_valid) {
+            const glm::vec3 decoded_normal = decodeOctahedron( glm::vec2(normal[0], normal[1]) / 32767.0f );
+            const float cosine = glm::clamp( glm::dot( normals[i] / length, decoded_normal ), -1.0f, 1.0f );
+            const float normal_error = std::acos( cosine );
+            max_normal_error = std::max( max_normal_error, normal_error );
+            if (normal_error > normal_bound) within_bound = false;
+         }
       }
+
       if (textures_exist) {
-         DataBuffer.push_back( textures[i].x );
-         DataBuffer.push_back( textures[i].y );
+         const uint32_t texture = glm::packHalf2x16( textures[i] );
+         std::memcpy( vertex + texture_offset, &texture, sizeof( texture ) );
+         const glm::vec2 texture_error = glm::abs( glm::unpackHalf2x16( texture ) - textures[i] );
+         const glm::vec2 texture_bound =
+            glm::max( glm::abs( textures[i] ), glm::vec2(std::numeric_limits<float>::min()) ) * texture_relative_bound;
+         max_texture_error = std::max( max_texture_error, glm::compMax( texture_error ) );
+         if (glm::any( glm::greaterThan( texture_error, texture_bound ) )) within_bound = false;
       }
-      VerticesCount++;
    }
-   int n = 3;
-   if (normals_exist) n += 3;
-   if (textures_exist) n += 2;
-   const auto n_bytes_per_vertex = static_cast<int>(n * sizeof( GLfloat ));
-   prepareVertexBuffer( n_bytes_per_vertex );
+
+   std::stringstream report;
+   report << "Compact vertex format: " << n_bytes_per_vertex << " bytes per vertex instead of "
+      << (3 + (normals_exist ? 3 : 0) + (textures_exist ? 2 : 0)) * sizeof( GLfloat ) << "\n"
+      << " - max position error: " << glm::compMax( max_position_error )
+      << " (bound " << glm::compMax( position_bound ) << ")\n";
+   if (normals_exist) report << " - max normal error: " << glm::degrees( max_normal_error ) << " degrees\n";
+   if (textures_exist) report << " - max texture coordinate error: " << max_texture_error << "\n";
+   std::cout << report.str();
+   if (!within_bound) return false;
+
+   DataBuffer = std::move( compact_buffer );
+   DequantizationMatrix = getDequantizationMatrix( BoundingBoxMin, BoundingBoxMax );
+   return true;
+}
+
+std::filesystem::path ObjectGL::getMeshCachePath(const std::string& obj_file_path)
+{
+   return std::filesystem::path(obj_file_path).replace_extension( ".svmesh" );
+}
+
+bool ObjectGL::readMeshCache(
+   bool& normals_exist,
+   bool& textures_exist,
+   const std::filesystem::path& cache_path,
+   const std::string& obj_file_path
+)
+{
+   std::error_code error;
+   const auto cache_time = std::filesystem::last_write_time( cache_path, error );
+   if (error) return false;
+   const auto obj_time = std::filesystem::last_write_time( obj_file_path, error );
+   if (error || cache_time < obj_time) return false;
+
+   const MappedFile file(cache_path.string());
+   if (!file.isOpen() || file.getSize() < sizeof( MeshCacheHeader )) return false;
+
+   MeshCacheHeader header{};
+   std::memcpy( &header, file.getData(), sizeof( MeshCacheHeader ) );
+   if (std::memcmp( header.Magic, MeshCacheMagic, sizeof( header.Magic ) ) != 0) return false;
+   if (header.Version != MeshCacheVersion) return false;
+   if (((header.Flags & MeshCacheAdjacencyMode) != 0) != AdjacencyMode) return false;
+   if (((header.Flags & MeshCacheOptimized) != 0) != OptimizeMesh) return false;
+   if (((header.Flags & MeshCacheCompactVertexRequested) != 0) != CompactVertexRequested) return false;
+   if (header.WeldingEpsilon != (AdjacencyMode ? WeldingEpsilon : 0.0f)) return false;
+
+   const auto data_size = static_cast<size_t>(header.FloatNum * sizeof( GLfloat ));
+   const auto index_size = static_cast<size_t>(header.IndexNum * sizeof( GLuint ));
+   if (sizeof( MeshCacheHeader ) + data_size + index_size != file.getSize()) return false;
+
+   const auto* data = reinterpret_cast<const GLfloat*>(file.getData() + sizeof( MeshCacheHeader ));
+   const auto* indices = reinterpret_cast<const GLuint*>(file.getData() + sizeof( MeshCacheHeader ) + data_size);
+   normals_exist = (header.Flags & MeshCacheNormalsExist) != 0;
+   textures_exist = (header.Flags & MeshCacheTexturesExist) != 0;
+   VerticesCount = static_cast<GLsizei>(header.VertexNum);
+   BoundingBoxMin = glm::make_vec3( header.BoundingBoxMin );
+   BoundingBoxMax = glm::make_vec3( header.BoundingBoxMax );
+   const bool compact_vertex = (header.Flags & MeshCacheCompactVertex) != 0;
+   if (compact_vertex) DequantizationMatrix = getDequantizationMatrix( BoundingBoxMin, BoundingBoxMax );
+
+   // The GPU buffers are filled straight from the mapped pages.
+   // The CPU-side copies are kept because updating or replacing vertices relies on them.
+   prepareVertexBuffer( static_cast<int>(header.VertexStride), data, static_cast<GLsizeiptr>(data_size), compact_vertex );
+   DataBuffer.assign( data, data + header.FloatNum );
+   IndexBuffer.assign( indices, indices + header.IndexNum );
+   if (!IndexBuffer.empty()) prepareIndexBuffer( indices, static_cast<GLsizeiptr>(index_size) );
+   return true;
+}
+
+void ObjectGL::writeMeshCache(
+   const std::filesystem::path& cache_path,
+   bool normals_exist,
+   bool textures_exist,
+   int n_bytes_per_vertex
+) const
+{
+   MeshCacheHeader header{};
+   std::memcpy( header.Magic, MeshCacheMagic, sizeof( header.Magic ) );
+   header.Version = MeshCacheVersion;
+   if (normals_exist) header.Flags |= MeshCacheNormalsExist;
+   if (textures_exist) header.Flags |= MeshCacheTexturesExist;
+   if (AdjacencyMode) header.Flags |= MeshCacheAdjacencyMode;
+   if (OptimizeMesh) header.Flags |= MeshCacheOptimized;
+   if (UseCompactVertexFormat) header.Flags |= MeshCacheCompactVertex;
+   if (CompactVertexRequested) header.Flags |= MeshCacheCompactVertexRequested;
+   header.VertexNum = static_cast<uint32_t>(VerticesCount);
+   header.VertexStride = static_cast<uint32_t>(n_bytes_per_vertex);
+   header.WeldingEpsilon = AdjacencyMode ? WeldingEpsilon : 0.0f;
+   header.FloatNum = DataBuffer.size();
+   header.IndexNum = IndexBuffer.size();
+   std::memcpy( header.BoundingBoxMin, &BoundingBoxMin[0], sizeof( header.BoundingBoxMin ) );
+   std::memcpy( header.BoundingBoxMax, &BoundingBoxMax[0], sizeof( header.BoundingBoxMax ) );
+
+   // Write to a temporary file first so that an interrupted write never leaves a broken cache behind.
+   std::filesystem::path temporary_path = cache_path;
+   temporary_path += ".tmp";
+   std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+   if (!file.is_open()) {
+      std::cerr << "Could not write mesh cache " << cache_path.string() << "\n";
+      return;
+   }
+   file.write( reinterpret_cast<const char*>(&header), sizeof( MeshCacheHeader ) );
+   file.write( reinterpret_cast<const char*>(DataBuffer.data()), static_cast<std::streamsize>(sizeof( GLfloat ) * DataBuffer.size()) );
+   file.write( reinterpret_cast<const char*>(IndexBuffer.data()), static_cast<std::streamsize>(sizeof( GLuint ) * IndexBuffer.size()) );
+   file.close();
+
+   std::error_code error;
+   if (file.fail()) {
+      std::cerr << "Could not write mesh cache " << cache_path.string() << "\n";
+      std::filesystem::remove( temporary_path, error );
+      return;
+   }
+   std::filesystem::rename( temporary_path, cache_path, error );
+   if (error) std::filesystem::remove( temporary_path, error );
+}
+
+bool ObjectGL::prepareObjectFile(bool& normals_exist, bool& textures_exist, const std::string& obj_file_path)
+{
+   const std::filesystem::path cache_path = getMeshCachePath( obj_file_path );
+   if (UseMeshCache && readMeshCache( normals_exist, textures_exist, cache_path, obj_file_path )) return true;
+
+   std::vector<glm::vec3> vertices, normals;
+   std::vector<glm::vec2> textures;
+   if (!readObjectFile( vertices, normals, textures, obj_file_path )) return false;
+
+   normals_exist = !normals.empty();
+   textures_exist = !textures.empty();
+   findBoundingBox( vertices );
+
+   int n_bytes_per_vertex = 0;
+   bool compact_vertex = CompactVertexRequested;
+   if (compact_vertex && !prepareCompactDataBuffer( n_bytes_per_vertex, vertices, normals, textures )) {
+      std::cout << "The compact vertex format exceeds its error bound, so the float format is used instead.\n";
+      compact_vertex = false;
+   }
+   if (!compact_vertex) {
+      int n = 3;
+      if (normals_exist) n += 3;
+      if (textures_exist) n += 2;
+      DataBuffer.clear();
+      DataBuffer.reserve( vertices.size() * n );
+      for (uint i = 0; i < vertices.size(); ++i) {
+         DataBuffer.push_back( vertices[i].x );
+         DataBuffer.push_back( vertices[i].y );
+         DataBuffer.push_back( vertices[i].z );
+         if (normals_exist) {
+            DataBuffer.push_back( normals[i].x );
+            DataBuffer.push_back( normals[i].y );
+            DataBuffer.push_back( normals[i].z );
+         }
+         if (textures_exist) {
+            DataBuffer.push_back( textures[i].x );
+            DataBuffer.push_back( textures[i].y );
+         }
+      }
+      n_bytes_per_vertex = static_cast<int>(n * sizeof( GLfloat ));
+   }
+   VerticesCount = static_cast<GLsizei>(vertices.size());
+
+   prepareVertexBuffer( n_bytes_per_vertex, compact_vertex );
+   if (!IndexBuffer.empty()) prepareIndexBuffer();
+   if (UseMeshCache) writeMeshCache( cache_path, normals_exist, textures_exist, n_bytes_per_vertex );
+   return true;
+}
+
+void ObjectGL::setObject(GLenum draw_mode, const std::string& obj_file_path)
+{
+   DrawMode = draw_mode;
+   AdjacencyMode = DrawMode == GL_TRIANGLES_ADJACENCY;
+   bool normals_exist = false, textures_exist = false;
+   if (!prepareObjectFile( normals_exist, textures_exist, obj_file_path )) return;
+
    if (normals_exist) prepareNormal();
    if (textures_exist) prepareTexture( normals_exist );
-   if (AdjacencyMode) prepareIndexBuffer();
 }
 
 void ObjectGL::setObject(
@@ -501,32 +865,14 @@ void ObjectGL::setObject(
 {
    DrawMode = draw_mode;
    AdjacencyMode = DrawMode == GL_TRIANGLES_ADJACENCY;
-   std::vector<glm::vec3> vertices, normals;
-   std::vector<glm::vec2> textures;
-   if (!readObjectFile( vertices, normals, textures, obj_file_path )) return;
+   bool normals_exist = false, textures_exist = false;
+   if (!prepareObjectFile( normals_exist, textures_exist, obj_file_path )) return;
 
-   assert( !textures.empty() );
+   assert( textures_exist );
 
-   const bool normals_exist = !normals.empty();
-   for (uint i = 0; i < vertices.size(); ++i) {
-      DataBuffer.push_back( vertices[i].x );
-      DataBuffer.push_back( vertices[i].y );
-      DataBuffer.push_back( vertices[i].z );
-      if (normals_exist) {
-         DataBuffer.push_back( normals[i].x );
-         DataBuffer.push_back( normals[i].y );
-         DataBuffer.push_back( normals[i].z );
-      }
-      DataBuffer.push_back( textures[i].x );
-      DataBuffer.push_back( textures[i].y );
-      VerticesCount++;
-   }
-   const int n_bytes_per_vertex = normals_exist ? 8 * sizeof( GLfloat ) : 5 * sizeof( GLfloat );
-   prepareVertexBuffer( n_bytes_per_vertex );
    if (normals_exist) prepareNormal();
    prepareTexture( normals_exist );
    addTexture( texture_file_name );
-   if (AdjacencyMode) prepareIndexBuffer();
 }
 
 void ObjectGL::setSquareObject(GLenum draw_mode, bool use_texture)
@@ -557,11 +903,14 @@ void ObjectGL::transferUniformsToShader(const ShaderGL* shader)
    glUniform4fv( shader->getMaterialDiffuseLocation(), 1, &DiffuseReflectionColor[0] );
    glUniform4fv( shader->getMaterialSpecularLocation(), 1, &SpecularReflectionColor[0] );
    glUniform1f( shader->getMaterialSpecularExponentLocation(), SpecularReflectionExponent );
+   glUniformMatrix4fv( shader->getDequantizationLocation(), 1, GL_FALSE, &DequantizationMatrix[0][0] );
+   glUniform1i( shader->getCompactVertexLocation(), UseCompactVertexFormat ? 1 : 0 );
 }
 
 void ObjectGL::updateDataBuffer(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& normals)
 {
-   assert( VBO != 0 );
+   // The vertices are written in the float format.
+   assert( VBO != 0 && !UseCompactVertexFormat );
 
    VerticesCount = 0;
    DataBuffer.clear();
@@ -575,6 +924,9 @@ void ObjectGL::updateDataBuffer(const std::vector<glm::vec3>& vertices, const st
       VerticesCount++;
    }
    glNamedBufferSubData( VBO, 0, static_cast<GLsizeiptr>(sizeof( GLfloat ) * DataBuffer.size()), DataBuffer.data() );
+   if (PositionVBO != 0) {
+      preparePositionBuffer( 6 * sizeof( GLfloat ), DataBuffer.data(), static_cast<GLsizeiptr>(sizeof( GLfloat ) * DataBuffer.size()) );
+   }
 }
 
 void ObjectGL::updateDataBuffer(
@@ -583,7 +935,8 @@ void ObjectGL::updateDataBuffer(
    const std::vector<glm::vec2>& textures
 )
 {
-   assert( VBO != 0 );
+   // The vertices are written in the float format.
+   assert( VBO != 0 && !UseCompactVertexFormat );
 
    VerticesCount = 0;
    DataBuffer.clear();
@@ -599,6 +952,9 @@ void ObjectGL::updateDataBuffer(
       VerticesCount++;
    }
    glNamedBufferSubData( VBO, 0, static_cast<GLsizeiptr>(sizeof( GLfloat ) * DataBuffer.size()), DataBuffer.data() );
+   if (PositionVBO != 0) {
+      preparePositionBuffer( 8 * sizeof( GLfloat ), DataBuffer.data(), static_cast<GLsizeiptr>(sizeof( GLfloat ) * DataBuffer.size()) );
+   }
 }
 
 void ObjectGL::replaceVertices(
@@ -607,7 +963,8 @@ void ObjectGL::replaceVertices(
    bool textures_exist
 )
 {
-   assert( VBO != 0 );
+   // The vertices are written in the float format.
+   assert( VBO != 0 && !UseCompactVertexFormat );
 
    VerticesCount = 0;
    int step = 3;
@@ -620,6 +977,13 @@ void ObjectGL::replaceVertices(
       VerticesCount++;
    }
    glNamedBufferSubData( VBO, 0, static_cast<GLsizeiptr>(sizeof( GLfloat ) * VerticesCount * step), DataBuffer.data() );
+   if (PositionVBO != 0) {
+      preparePositionBuffer(
+         static_cast<int>(step * sizeof( GLfloat )),
+         DataBuffer.data(),
+         static_cast<GLsizeiptr>(sizeof( GLfloat ) * VerticesCount * step)
+      );
+   }
 }
 
 void ObjectGL::replaceVertices(
@@ -628,7 +992,8 @@ void ObjectGL::replaceVertices(
    bool textures_exist
 )
 {
-   assert( VBO != 0 );
+   // The vertices are written in the float format.
+   assert( VBO != 0 && !UseCompactVertexFormat );
 
    VerticesCount = 0;
    int step = 3;
@@ -641,4 +1006,11 @@ void ObjectGL::replaceVertices(
       VerticesCount++;
    }
    glNamedBufferSubData( VBO, 0, static_cast<GLsizeiptr>(sizeof( GLfloat ) * VerticesCount * step), DataBuffer.data() );
+   if (PositionVBO != 0) {
+      preparePositionBuffer(
+         static_cast<int>(step * sizeof( GLfloat )),
+         DataBuffer.data(),
+         static_cast<GLsizeiptr>(sizeof( GLfloat ) * VerticesCount * step)
+      );
+   }
 }
\ No newline at end of file
@@ -1,17 +1,45 @@
 #include "renderer.h"
 
-RendererGL::RendererGL() :
-   Window( nullptr ), Pause( false ), Robust( true ), FrameWidth( 1920 ), FrameHeight( 1080 ), ActiveLightIndex( 0 ),
+#ifdef USE_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+RendererGL::RendererGL() : RendererGL( 0 )
+{
+}
+
+RendererGL::RendererGL(int headless_frame_num) :
+   Window( nullptr ), HeadlessDisplay( nullptr ), HeadlessContext( nullptr ), Headless( headless_frame_num > 0 ),
+   Initialized( false ), Pause( false ), Robust( true ), UseShadowVolumeCache( false ), UseMultipleLights( false ), UseFiniteExtrusion( false ), UseInstancing( false ),
+   FrameWidth( 1920 ), FrameHeight( 1080 ), ActiveLightIndex( 0 ), HeadlessFrameNum( headless_frame_num ),
    ClickedPoint( -1, -1 ), Texter( std::make_unique<TextGL>() ), MainCamera( std::make_unique<CameraGL>() ),
-   TextCamera( std::make_unique<CameraGL>() ), TextShader( std::make_unique<ShaderGL>() ),
-   ShadowVolumeShader( std::make_unique<ShaderGL>() ), SceneShader( std::make_unique<ShaderGL>() ),
-   WallObject( std::make_unique<ObjectGL>() ), LucyObject( std::make_unique<ObjectGL>() ),
-   Lights( std::make_unique<LightGL>() ), AlgorithmToCompare( ALGORITHM_TO_COMPARE::Z_FAIL )
+   TextCamera( std::make_unique<CameraGL>() ),
+   CaptureCamera(
+      std::make_unique<CameraGL>( glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f) )
+   ), TextShader( std::make_unique<ShaderGL>() ), ShadowVolumeShader( std::make_unique<ShaderGL>() ),
+   ShadowVolumeCaptureShader( std::make_unique<ShaderGL>() ), SceneShader( std::make_unique<ShaderGL>() ),
+   DepthShader( std::make_unique<ShaderGL>() ), SilhouetteShader( std::make_unique<ShaderGL>() ),
+   ShadowVolumeIndirectShader( std::make_unique<ShaderGL>() ), ShadowVolumeCPUShader( std::make_unique<ShaderGL>() ),
+   ShadowMaskShader( std::make_unique<ShaderGL>() ), StaticBatch( std::make_unique<StaticBatchGL>() ),
+   LucyObject( std::make_unique<ObjectGL>() ), Lights( std::make_unique<LightGL>() ), VolumeGenerator( std::make_unique<ShadowVolumeGenerator>() ),
+   ShadowMask( std::make_unique<ShadowMaskGL>() ), Profiler( std::make_unique<GPUProfilerGL>() ),
+   Statistics( std::make_unique<FrameStatistics>() ), AlgorithmToCompare( ALGORITHM_TO_COMPARE::Z_FAIL ),
+   ShadowVolumeBackend( SHADOW_VOLUME_BACKEND::GEOMETRY_SHADER ),
+   LucyWorldMatrix(
+      glm::translate( glm::mat4(1.0f), glm::vec3(100.0f, 200.0f, 30.0f) ) *
+      glm::rotate( glm::mat4(1.0f), glm::radians( 180.0f ), glm::vec3(0.0f, 0.0f, 1.0f) ) *
+      glm::rotate( glm::mat4(1.0f), glm::radians( 90.0f ), glm::vec3(1.0f, 0.0f, 0.0f) ) *
+      glm::scale( glm::mat4(1.0f), glm::vec3(0.35f, 0.35f, 0.35f) )
+   ), ShadowVolumeVAO( 0 ), SilhouetteBuffer( 0 ), ShadowVolumeCommandBuffer( 0 ), CPUVolumeVAO( 0 ),
+   CPUVolumeBuffer( 0 ), DepthBounds( nullptr ), MainFramebuffer( 0 ), MainColorBuffer( 0 ),
+   MainDepthStencilBuffer( 0 ), MainDrawBuffer( GL_BACK ), MainDepthStencilFormat( GL_DEPTH24_STENCIL8 )
 {
    Renderer = this;
 
-   initialize();
-   printOpenGLInformation();
+   Initialized = initialize();
+   if (Initialized) printOpenGLInformation();
 }
 
 void RendererGL::printOpenGLInformation()
@@ -24,29 +52,166 @@ void RendererGL::printOpenGLInformation()
    std::cout << "****************************************************************\n\n";
 }
 
-void RendererGL::initialize()
+bool RendererGL::createHeadlessContext()
 {
-   if (!glfwInit()) {
-      std::cout << "Cannot Initialize OpenGL...\n";
-      return;
+#ifdef USE_EGL
+   // The surfaceless platform needs neither a display server nor a GPU, so it also runs with llvmpipe.
+   EGLDisplay display = eglGetPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr );
+   if (display == EGL_NO_DISPLAY) display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+   EGLint major, minor;
+   if (display == EGL_NO_DISPLAY || eglInitialize( display, &major, &minor ) == EGL_FALSE) {
+      std::cout << "Cannot Initialize EGL...\n";
+      return false;
    }
-   glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 4 );
-   glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 6 );
-   glfwWindowHint( GLFW_DOUBLEBUFFER, GLFW_TRUE );
-   glfwWindowHint( GLFW_RESIZABLE, GLFW_FALSE );
-   glfwWindowHint( GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE );
-
-   Window = glfwCreateWindow( FrameWidth, FrameHeight, "Shadow Volumes", nullptr, nullptr );
-   glfwMakeContextCurrent( Window );
+   eglBindAPI( EGL_OPENGL_API );
+
+   // Nothing is rendered to an EGL surface, so any surface type is fine.
+   const std::array<EGLint, 5> config_attributes{ EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+   EGLConfig config;
+   EGLint config_num = 0;
+   eglChooseConfig( display, config_attributes.data(), &config, 1, &config_num );
+
+   const std::array<EGLint, 7> context_attributes{
+      EGL_CONTEXT_MAJOR_VERSION, 4,
+      EGL_CONTEXT_MINOR_VERSION, 6,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE
+   };
+   EGLContext context = config_num > 0 ?
+      eglCreateContext( display, config, EGL_NO_CONTEXT, context_attributes.data() ) : EGL_NO_CONTEXT;
+   if (context == EGL_NO_CONTEXT || eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) == EGL_FALSE) {
+      std::cout << "Cannot Create an OpenGL 4.6 Core Context with EGL...\n";
+      std::cout << "(Mesa drivers may need MESA_GL_VERSION_OVERRIDE=4.6 and MESA_GLSL_VERSION_OVERRIDE=460)\n";
+      if (context != EGL_NO_CONTEXT) eglDestroyContext( display, context );
+      eglTerminate( display );
+      return false;
+   }
+   HeadlessDisplay = display;
+   HeadlessContext = context;
 
-   if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+   if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
       std::cout << "Failed to initialize GLAD" << std::endl;
+      destroyHeadlessContext();
+      return false;
+   }
+   return true;
+#else
+   std::cout << "Headless Mode Needs EGL, which This Build Does Not Use...\n";
+   return false;
+#endif
+}
+
+void RendererGL::destroyHeadlessContext()
+{
+#ifdef USE_EGL
+   if (HeadlessDisplay == nullptr) return;
+
+   eglMakeCurrent( HeadlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+   if (HeadlessContext != nullptr) eglDestroyContext( HeadlessDisplay, HeadlessContext );
+   eglTerminate( HeadlessDisplay );
+#endif
+   HeadlessDisplay = nullptr;
+   HeadlessContext = nullptr;
+}
+
+void RendererGL::prepareMainFramebuffer()
+{
+   if (!Headless) {
+      MainFramebuffer = 0;
+      MainDrawBuffer = GL_BACK;
       return;
    }
 
-   registerCallbacks();
+   glCreateRenderbuffers( 1, &MainColorBuffer );
+   glNamedRenderbufferStorage( MainColorBuffer, GL_RGBA8, FrameWidth, FrameHeight );
+   glCreateRenderbuffers( 1, &MainDepthStencilBuffer );
+   glNamedRenderbufferStorage( MainDepthStencilBuffer, MainDepthStencilFormat, FrameWidth, FrameHeight );
+
+   glCreateFramebuffers( 1, &MainFramebuffer );
+   glNamedFramebufferRenderbuffer( MainFramebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, MainColorBuffer );
+   glNamedFramebufferRenderbuffer( MainFramebuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, MainDepthStencilBuffer );
+   if (glCheckNamedFramebufferStatus( MainFramebuffer, GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cerr << "Main framebuffer is not complete\n";
+   }
+   MainDrawBuffer = GL_COLOR_ATTACHMENT0;
+   glNamedFramebufferDrawBuffer( MainFramebuffer, MainDrawBuffer );
+   glNamedFramebufferReadBuffer( MainFramebuffer, MainDrawBuffer );
+   StateCacheGL::getInstance().bindFramebuffer( MainFramebuffer );
+}
+
+void RendererGL::releaseMainFramebuffer()
+{
+   if (MainFramebuffer != 0) glDeleteFramebuffers( 1, &MainFramebuffer );
+   if (MainColorBuffer != 0) glDeleteRenderbuffers( 1, &MainColorBuffer );
+   if (MainDepthStencilBuffer != 0) glDeleteRenderbuffers( 1, &MainDepthStencilBuffer );
+   MainFramebuffer = 0;
+   MainColorBuffer = 0;
+   MainDepthStencilBuffer = 0;
+   StateCacheGL::getInstance().invalidate();
+}
+
+void* RendererGL::getProcAddress(const char* name) const
+{
+#ifdef USE_EGL
+   if (Headless) return reinterpret_cast<void*>(eglGetProcAddress( name ));
+#endif
+   return reinterpret_cast<void*>(glfwGetProcAddress( name ));
+}
+
+bool RendererGL::isExtensionSupported(const std::string& name)
+{
+   GLint extension_num = 0;
+   glGetIntegerv( GL_NUM_EXTENSIONS, &extension_num );
+   for (GLint i = 0; i < extension_num; ++i) {
+      if (name == reinterpret_cast<const char*>(glGetStringi( GL_EXTENSIONS, static_cast<GLuint>(i) ))) return true;
+   }
+   return false;
+}
+
+bool RendererGL::initialize()
+{
+   if (Headless) {
+      if (!createHeadlessContext()) return false;
+   }
+   else {
+      if (!glfwInit()) {
+         std::cout << "Cannot Initialize OpenGL...\n";
+         return false;
+      }
+      glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 4 );
+      glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 6 );
+      glfwWindowHint( GLFW_DOUBLEBUFFER, GLFW_TRUE );
+      glfwWindowHint( GLFW_RESIZABLE, GLFW_FALSE );
+      // The shadow mask copies the depth with a blit, which needs the same depth-stencil format as its target.
+      glfwWindowHint( GLFW_DEPTH_BITS, 24 );
+      glfwWindowHint( GLFW_STENCIL_BITS, 8 );
+      glfwWindowHint( GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE );
+
+      Window = glfwCreateWindow( FrameWidth, FrameHeight, "Shadow Volumes", nullptr, nullptr );
+      if (Window == nullptr) {
+         std::cout << "Cannot Create the Window...\n";
+         return false;
+      }
+      glfwMakeContextCurrent( Window );
 
-   glEnable( GL_DEPTH_TEST );
+      if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+         std::cout << "Failed to initialize GLAD" << std::endl;
+         return false;
+      }
+
+      registerCallbacks();
+   }
+   // A new context starts with the default states, whatever the cache has seen before.
+   StateCacheGL& state = StateCacheGL::getInstance();
+   state.invalidate();
+   prepareMainFramebuffer();
+
+   if (isExtensionSupported( "GL_EXT_depth_bounds_test" )) {
+      DepthBounds = reinterpret_cast<PFNGLDEPTHBOUNDSEXTPROC>(getProcAddress( "glDepthBoundsEXT" ));
+   }
+
+   state.enable( GL_DEPTH_TEST );
    glClearColor( 0.1f, 0.1f, 0.1f, 1.0f );
 
    Texter->initialize( 30.0f );
@@ -64,10 +229,34 @@ void RendererGL::initialize()
       std::string(shader_directory_path + "/shadow_volume.frag").c_str(),
       std::string(shader_directory_path + "/shadow_volume.geom").c_str()
    );
+   ShadowVolumeCaptureShader->setShader(
+      std::string(shader_directory_path + "/shadow_volume.vert").c_str(),
+      std::string(shader_directory_path + "/shadow_volume.frag").c_str(),
+      std::string(shader_directory_path + "/shadow_volume.geom").c_str()
+   );
+   ShadowVolumeCaptureShader->setTransformFeedbackVaryings( { "gl_Position" } );
    SceneShader->setShader(
       std::string(shader_directory_path + "/scene_shader.vert").c_str(),
       std::string(shader_directory_path + "/scene_shader.frag").c_str()
    );
+   DepthShader->setShader(
+      std::string(shader_directory_path + "/depth_only.vert").c_str(),
+      std::string(shader_directory_path + "/depth_only.frag").c_str()
+   );
+   SilhouetteShader->setComputeShaders( std::string(shader_directory_path + "/silhouette.comp").c_str() );
+   ShadowVolumeIndirectShader->setShader(
+      std::string(shader_directory_path + "/shadow_volume_indirect.vert").c_str(),
+      std::string(shader_directory_path + "/shadow_volume.frag").c_str()
+   );
+   ShadowVolumeCPUShader->setShader(
+      std::string(shader_directory_path + "/shadow_volume_cpu.vert").c_str(),
+      std::string(shader_directory_path + "/shadow_volume.frag").c_str()
+   );
+   ShadowMaskShader->setShader(
+      std::string(shader_directory_path + "/shadow_mask.vert").c_str(),
+      std::string(shader_directory_path + "/shadow_mask.frag").c_str()
+   );
+   return true;
 }
 
 void RendererGL::writeFrame(const std::string& name) const
@@ -75,7 +264,8 @@ void RendererGL::writeFrame(const std::string& name) const
    const int size = FrameWidth * FrameHeight * 3;
    auto* buffer = new uint8_t[size];
    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
-   glReadBuffer( GL_COLOR_ATTACHMENT0 );
+   glBindFramebuffer( GL_READ_FRAMEBUFFER, MainFramebuffer );
+   glReadBuffer( MainDrawBuffer );
    glReadPixels( 0, 0, FrameWidth, FrameHeight, GL_BGR, GL_UNSIGNED_BYTE, buffer );
    FIBITMAP* image = FreeImage_ConvertFromRawBits(
       buffer, FrameWidth, FrameHeight, FrameWidth * 3, 24,
@@ -92,7 +282,7 @@ void RendererGL::writeDepthTexture(const std::string& name) const
    auto* buffer = new uint8_t[size];
    auto* raw_buffer = new GLfloat[size];
    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
-   glReadBuffer( GL_DEPTH_ATTACHMENT );
+   glBindFramebuffer( GL_READ_FRAMEBUFFER, MainFramebuffer );
    glReadPixels( 0, 0, FrameWidth, FrameHeight, GL_DEPTH_COMPONENT, GL_FLOAT, raw_buffer );
    for (int i = 0; i < size; ++i) {
       buffer[i] = static_cast<uint8_t>(MainCamera->linearizeDepthValue( raw_buffer[i] ) * 255.0f);
@@ -113,7 +303,7 @@ void RendererGL::writeStencilTexture(const std::string& name) const
    auto* buffer = new uint8_t[size];
    auto* raw_buffer = new uint32_t[size];
    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
-   glReadBuffer( GL_STENCIL_ATTACHMENT );
+   glBindFramebuffer( GL_READ_FRAMEBUFFER, MainFramebuffer );
    glReadPixels( 0, 0, FrameWidth, FrameHeight, GL_STENCIL_INDEX, GL_UNSIGNED_INT, raw_buffer );
    for (int i = 0 ; i < size; ++i) buffer[i] = raw_buffer[i] == 0 ? 255 : 0;
    FIBITMAP* image = FreeImage_ConvertFromRawBits(
@@ -148,12 +338,74 @@ void RendererGL::keyboard(GLFWwindow* window, int key, int scancode, int action,
             std::cout << "Z-Pass Algorithm Selected\n";
          }
          break;
+      case GLFW_KEY_3:
+         if (!Renderer->Pause) {
+            Renderer->AlgorithmToCompare = ALGORITHM_TO_COMPARE::AUTOMATIC;
+            std::cout << "Automatic Algorithm Selected\n";
+         }
+         break;
+      case GLFW_KEY_B:
+         if (!Renderer->Pause) {
+            switch (Renderer->ShadowVolumeBackend) {
+               case SHADOW_VOLUME_BACKEND::GEOMETRY_SHADER:
+                  Renderer->ShadowVolumeBackend = SHADOW_VOLUME_BACKEND::COMPUTE_SHADER;
+                  std::cout << "Compute Shader Backend Selected\n";
+                  break;
+               case SHADOW_VOLUME_BACKEND::COMPUTE_SHADER:
+                  Renderer->ShadowVolumeBackend = SHADOW_VOLUME_BACKEND::CPU;
+                  std::cout << "CPU Backend Selected\n";
+                  break;
+               case SHADOW_VOLUME_BACKEND::CPU:
+                  Renderer->ShadowVolumeBackend = SHADOW_VOLUME_BACKEND::GEOMETRY_SHADER;
+                  std::cout << "Geometry Shader Backend Selected\n";
+                  break;
+            }
+         }
+         break;
       case GLFW_KEY_R:
          if (!Renderer->Pause) Renderer->Robust = !Renderer->Robust;
          break;
+      case GLFW_KEY_M:
+         if (!Renderer->Pause) {
+            Renderer->UseMultipleLights = !Renderer->UseMultipleLights;
+            std::cout << (Renderer->UseMultipleLights ? "Multiple Lights Selected\n" : "Single Light Selected\n");
+         }
+         break;
+      case GLFW_KEY_E:
+         if (!Renderer->Pause) {
+            Renderer->UseFiniteExtrusion = !Renderer->UseFiniteExtrusion;
+            std::cout << (Renderer->UseFiniteExtrusion ? "Finite Extrusion Selected\n" : "Infinite Extrusion Selected\n");
+         }
+         break;
+      case GLFW_KEY_I:
+         if (!Renderer->Pause) {
+            Renderer->UseInstancing = !Renderer->UseInstancing;
+            std::cout << (Renderer->UseInstancing ? "Instancing Selected\n" : "Single Caster Selected\n");
+         }
+         break;
+      case GLFW_KEY_D:
+         if (!Renderer->Pause) {
+            const int scale = Renderer->ShadowMask->getScale() < 4 ? Renderer->ShadowMask->getScale() * 2 : 1;
+            Renderer->ShadowMask->initialize(
+               Renderer->FrameWidth, Renderer->FrameHeight, scale, Renderer->MainFramebuffer,
+               Renderer->MainDepthStencilFormat
+            );
+            if (scale > 1) std::cout << "Shadow Mask at 1/" << scale << " Resolution Selected\n";
+            else std::cout << "Full Resolution Shadow Selected\n";
+         }
+         break;
+      case GLFW_KEY_V:
+         if (!Renderer->Pause) {
+            Renderer->UseShadowVolumeCache = !Renderer->UseShadowVolumeCache;
+            std::cout << "Shadow Volume Cache " << (Renderer->UseShadowVolumeCache ? "Enabled\n" : "Disabled\n");
+         }
+         break;
       case GLFW_KEY_C:
          Renderer->writeFrame( "../result.png" );
          break;
+      case GLFW_KEY_S:
+         Renderer->writeFrameStatistics();
+         break;
       case GLFW_KEY_L:
          Renderer->Lights->toggleLightSwitch();
          std::cout << "Light Turned " << (Renderer->Lights->isLightOn() ? "On!\n" : "Off!\n");
@@ -234,7 +486,30 @@ void RendererGL::setLights() const
    const glm::vec4 ambient_color(1.0f, 1.0f, 1.0f, 1.0f);
    const glm::vec4 diffuse_color(0.9f, 0.9f, 0.9f, 1.0f);
    const glm::vec4 specular_color(0.9f, 0.9f, 0.9f, 1.0f);
-   Lights->addLight( light_position, ambient_color, diffuse_color, specular_color );
+   // The main light covers the whole scene, so its additive pass is neither faded nor bounded
+   // in the multiple lights mode, and it is attenuated as in the single light mode.
+   Lights->addLight(
+      light_position, ambient_color, diffuse_color, specular_color,
+      glm::vec3(0.0f, 0.0f, -1.0f), 180.0f, 0.0f, 1000.0f, false
+   );
+
+   // These local lights are only shaded in the multiple lights mode.
+   const glm::vec4 no_ambient_color(0.0f, 0.0f, 0.0f, 1.0f);
+   Lights->addLight(
+      glm::vec4(-300.0f, 300.0f, 300.0f, 1.0f), no_ambient_color,
+      glm::vec4(0.8f, 0.3f, 0.3f, 1.0f), glm::vec4(0.8f, 0.3f, 0.3f, 1.0f),
+      glm::vec3(0.0f, 0.0f, -1.0f), 180.0f, 0.0f, 500.0f
+   );
+   Lights->addLight(
+      glm::vec4(300.0f, 250.0f, -300.0f, 1.0f), no_ambient_color,
+      glm::vec4(0.3f, 0.3f, 0.8f, 1.0f), glm::vec4(0.3f, 0.3f, 0.8f, 1.0f),
+      glm::vec3(0.0f, 0.0f, -1.0f), 180.0f, 0.0f, 500.0f
+   );
+   Lights->addLight(
+      glm::vec4(-200.0f, 600.0f, -200.0f, 1.0f), no_ambient_color,
+      glm::vec4(0.3f, 0.8f, 0.3f, 1.0f), glm::vec4(0.3f, 0.8f, 0.3f, 1.0f),
+      glm::vec3(0.0f, 0.0f, -1.0f), 180.0f, 0.0f, 450.0f
+   );
 }
 
 void RendererGL::setWallObject() const
@@ -244,27 +519,46 @@ void RendererGL::setWallObject() const
    wall_vertices.emplace_back( half_length, 0.0f, half_length );
    wall_vertices.emplace_back( half_length, 0.0f, -half_length );
    wall_vertices.emplace_back( -half_length, 0.0f, -half_length );
-
    wall_vertices.emplace_back( -half_length, 0.0f, half_length );
-   wall_vertices.emplace_back( half_length, 0.0f, half_length );
-   wall_vertices.emplace_back( -half_length, 0.0f, -half_length );
 
    std::vector<glm::vec3> wall_normals;
    wall_normals.emplace_back( 0.0f, 1.0f, 0.0f );
-   wall_normals.emplace_back( 0.0f, 1.0f, 0.0f );
-   wall_normals.emplace_back( 0.0f, 1.0f, 0.0f );
-
    wall_normals.emplace_back( 0.0f, 1.0f, 0.0f );
    wall_normals.emplace_back( 0.0f, 1.0f, 0.0f );
    wall_normals.emplace_back( 0.0f, 1.0f, 0.0f );
 
-   WallObject->setObject( GL_TRIANGLES, wall_vertices, wall_normals );
-   WallObject->setDiffuseReflectionColor( { 1.0f, 1.0f, 1.0f, 1.0f } );
+   const std::vector<GLuint> wall_indices = { 0, 1, 2, 3, 0, 2 };
+
+   const int wall = StaticBatch->addMesh( wall_vertices, wall_normals, wall_indices );
+
+   StaticBatchGL::Material material;
+   material.DiffuseReflectionColor = { 0.27f, 0.49f, 0.81f, 1.0f };
+   StaticBatch->addDraw( wall, glm::mat4(1.0f), material );
+
+   material.DiffuseReflectionColor = { 0.32f, 0.81f, 0.29f, 1.0f };
+   StaticBatch->addDraw(
+      wall,
+      glm::translate( glm::mat4(1.0f), glm::vec3(0.0f, 512.0f, -512.0f) ) *
+      glm::rotate( glm::mat4(1.0f), glm::radians( 90.0f ), glm::vec3(1.0f, 0.0f, 0.0f) ),
+      material
+   );
+
+   material.DiffuseReflectionColor = { 0.83f, 0.35f, 0.29f, 1.0f };
+   StaticBatch->addDraw(
+      wall,
+      glm::translate( glm::mat4(1.0f), glm::vec3(-512.0f, 512.0f, 0.0f) ) *
+      glm::rotate( glm::mat4(1.0f), glm::radians( -90.0f ), glm::vec3(0.0f, 0.0f, 1.0f) ),
+      material
+   );
+   StaticBatch->build();
 }
 
 void RendererGL::setLucyObject() const
 {
    const std::string sample_directory_path = std::string(CMAKE_SOURCE_DIR) + "/samples";
+   LucyObject->setMeshOptimization( true );
+   LucyObject->setCompactVertexFormat( true );
+   LucyObject->setPositionStream( true );
    LucyObject->setObject(
       GL_TRIANGLES_ADJACENCY,
       std::string(sample_directory_path + "/Lucy/lucy.obj")
@@ -272,6 +566,93 @@ void RendererGL::setLucyObject() const
    LucyObject->setDiffuseReflectionColor( { 1.0f, 1.0f, 1.0f, 1.0f } );
 }
 
+void RendererGL::setLucyInstances() const
+{
+   // The copies stand on a grid over the floor, each scaled down around the origin first.
+   constexpr int grid_size = 10;
+   constexpr float spacing = 90.0f;
+   std::vector<glm::mat4> transforms;
+   transforms.reserve( grid_size * grid_size );
+   for (int z = 0; z < grid_size; ++z) {
+      for (int x = 0; x < grid_size; ++x) {
+         const glm::vec3 translation(
+            (static_cast<float>(x) - static_cast<float>(grid_size - 1) * 0.5f) * spacing,
+            0.0f,
+            (static_cast<float>(z) - static_cast<float>(grid_size - 1) * 0.5f) * spacing
+         );
+         transforms.emplace_back(
+            glm::translate( glm::mat4(1.0f), translation ) * glm::scale( glm::mat4(1.0f), glm::vec3(0.2f) )
+         );
+      }
+   }
+   LucyObject->setInstanceTransforms( transforms );
+}
+
+void RendererGL::getLucyWorldMatrices(std::vector<glm::mat4>& world_matrices) const
+{
+   world_matrices.clear();
+   if (!UseInstancing || LucyObject->getInstanceNum() == 0) {
+      world_matrices.emplace_back( LucyWorldMatrix );
+      return;
+   }
+
+   for (const auto& transform : LucyObject->getInstanceTransforms()) {
+      world_matrices.emplace_back( transform * LucyWorldMatrix );
+   }
+}
+
+void RendererGL::prepareSilhouetteBuffers()
+{
+   // A triangle appends at most one record for its caps and one for each of its three edges.
+   const GLsizei triangle_num = (LucyObject->isIndexed() ? LucyObject->getIndexNum() : LucyObject->getVertexNum()) / 6;
+   glCreateBuffers( 1, &SilhouetteBuffer );
+   glNamedBufferStorage( SilhouetteBuffer, sizeof( GLuint ) * 4 * std::max( triangle_num, 1 ), nullptr, 0 );
+
+   const std::array<GLuint, 4> command = { 0, 1, 0, 0 };
+   glCreateBuffers( 1, &ShadowVolumeCommandBuffer );
+   glNamedBufferStorage( ShadowVolumeCommandBuffer, sizeof( command ), command.data(), GL_DYNAMIC_STORAGE_BIT );
+
+   // The volume vertices are generated from the records, so nothing is fetched through the vertex array.
+   glCreateVertexArrays( 1, &ShadowVolumeVAO );
+
+   std::vector<glm::vec3> positions;
+   LucyObject->getPositions( positions );
+   VolumeGenerator->setMesh( positions, LucyObject->getIndexBuffer(), ThreadPool::getInstance() );
+
+   // The generated vertices are streamed every frame, so the storage stays mutable.
+   glCreateBuffers( 1, &CPUVolumeBuffer );
+   glCreateVertexArrays( 1, &CPUVolumeVAO );
+   glVertexArrayVertexBuffer( CPUVolumeVAO, 0, CPUVolumeBuffer, 0, sizeof( glm::vec4 ) );
+   glVertexArrayAttribFormat( CPUVolumeVAO, 0, 4, GL_FLOAT, GL_FALSE, 0 );
+   glEnableVertexArrayAttrib( CPUVolumeVAO, 0 );
+   glVertexArrayAttribBinding( CPUVolumeVAO, 0, 0 );
+
+   // Most of the lit triangles emit two caps, so this grows only if many silhouette quads are added.
+   // Each light keeps its own volume for each algorithm, so that neither the lights nor the algorithms
+   // chosen per caster evict each other.
+   VolumeCaches.resize( Lights->getTotalLightNum() * 2 );
+   for (auto& cache : VolumeCaches) {
+      cache = std::make_unique<ShadowVolumeCacheGL>();
+      cache->initialize( static_cast<GLsizeiptr>(triangle_num) * 2 );
+   }
+}
+
+void RendererGL::releaseSilhouetteBuffers()
+{
+   if (SilhouetteBuffer != 0) glDeleteBuffers( 1, &SilhouetteBuffer );
+   if (ShadowVolumeCommandBuffer != 0) glDeleteBuffers( 1, &ShadowVolumeCommandBuffer );
+   if (ShadowVolumeVAO != 0) glDeleteVertexArrays( 1, &ShadowVolumeVAO );
+   if (CPUVolumeBuffer != 0) glDeleteBuffers( 1, &CPUVolumeBuffer );
+   if (CPUVolumeVAO != 0) glDeleteVertexArrays( 1, &CPUVolumeVAO );
+   SilhouetteBuffer = 0;
+   ShadowVolumeCommandBuffer = 0;
+   ShadowVolumeVAO = 0;
+   CPUVolumeBuffer = 0;
+   CPUVolumeVAO = 0;
+   VolumeCaches.clear();
+   StateCacheGL::getInstance().invalidate();
+}
+
 void RendererGL::getBoundingBox(std::array<glm::vec3, 8>& bounding_box, const std::array<glm::vec3, 8>& points)
 {
    auto min_point = glm::vec3(std::numeric_limits<float>::max());
@@ -296,152 +677,610 @@ void RendererGL::getBoundingBox(std::array<glm::vec3, 8>& bounding_box, const st
    bounding_box[7] = glm::vec3(max_point.x, max_point.y, max_point.z);
 }
 
-void RendererGL::drawBoxObject(ShaderGL* shader, const CameraGL* camera) const
+void RendererGL::getWorldBoundingBox(
+   std::array<glm::vec3, 8>& bounding_box,
+   const ObjectGL* object,
+   const glm::mat4& to_world
+)
 {
-   glm::mat4 to_world(1.0f);
-   shader->transferBasicTransformationUniforms( to_world, camera );
-   WallObject->setDiffuseReflectionColor( { 0.27f, 0.49f, 0.81f, 1.0f } );
-   WallObject->transferUniformsToShader( shader );
-   glBindVertexArray( WallObject->getVAO() );
-   glDrawArrays( WallObject->getDrawMode(), 0, WallObject->getVertexNum() );
+   const glm::vec3& min_point = object->getBoundingBoxMin();
+   const glm::vec3& max_point = object->getBoundingBoxMax();
+   std::array<glm::vec3, 8> points;
+   for (int i = 0; i < 8; ++i) {
+      const glm::vec3 corner(
+         (i & 1) ? max_point.x : min_point.x,
+         (i & 4) ? max_point.y : min_point.y,
+         (i & 2) ? max_point.z : min_point.z
+      );
+      points[i] = glm::vec3(to_world * glm::vec4(corner, 1.0f));
+   }
+   getBoundingBox( bounding_box, points );
+}
 
-   to_world =
-      glm::translate( glm::mat4(1.0f), glm::vec3(0.0f, 512.0f, -512.0f) ) *
-      glm::rotate( glm::mat4(1.0f), glm::radians( 90.0f ), glm::vec3(1.0f, 0.0f, 0.0f) );
-   shader->transferBasicTransformationUniforms( to_world, camera );
-   WallObject->setDiffuseReflectionColor( { 0.32f, 0.81f, 0.29f, 1.0f } );
-   WallObject->transferUniformsToShader( shader );
-   glDrawArrays( WallObject->getDrawMode(), 0, WallObject->getVertexNum() );
+bool RendererGL::isShadowVolumeVisible(const ObjectGL* caster, const glm::mat4& to_world, int light_index) const
+{
+   std::array<glm::vec3, 8> bounding_box;
+   getWorldBoundingBox( bounding_box, caster, to_world );
+
+   // A caster entirely out of the influence sphere has nothing to shadow when the volume is bounded by the sphere.
+   const glm::vec4 light_position = Lights->getLightPosition( light_index );
+   const bool is_point_light = light_position.w != 0.0f;
+   const glm::vec3 light = is_point_light ? glm::vec3(light_position) / light_position.w : glm::vec3(light_position);
+   const float extrusion_radius = getExtrusionRadius( light_index );
+   if (extrusion_radius > 0.0f) {
+      const glm::vec3 closest_point = glm::clamp( light, bounding_box[0], bounding_box[7] );
+      if (glm::distance( closest_point, light ) > extrusion_radius) return false;
+   }
 
-   to_world =
-      glm::translate( glm::mat4(1.0f), glm::vec3(-512.0f, 512.0f, 0.0f) ) *
-      glm::rotate( glm::mat4(1.0f), glm::radians( -90.0f ), glm::vec3(0.0f, 0.0f, 1.0f) );
-   shader->transferBasicTransformationUniforms( to_world, camera );
-   WallObject->setDiffuseReflectionColor( { 0.83f, 0.35f, 0.29f, 1.0f } );
-   WallObject->transferUniformsToShader( shader );
-   glDrawArrays( WallObject->getDrawMode(), 0, WallObject->getVertexNum() );
+   // The hull is spanned by the world AABB and its directions away from the light.
+   // A point light inside the box casts the volume in every direction.
+   if (is_point_light &&
+       glm::all( glm::greaterThanEqual( light, bounding_box[0] ) ) &&
+       glm::all( glm::lessThanEqual( light, bounding_box[7] ) )) return true;
+
+   std::array<glm::vec4, 16> hull;
+   for (int i = 0; i < 8; ++i) {
+      hull[i] = glm::vec4(bounding_box[i], 1.0f);
+      hull[i + 8] = glm::vec4(is_point_light ? bounding_box[i] - light : -light, 0.0f);
+   }
+
+   // The far plane is not tested because the volume is drawn with the depth clamp.
+   std::array<glm::vec4, 6> planes;
+   MainCamera->getFrustumPlanes( planes );
+   for (int p = 0; p < 5; ++p) {
+      bool outside = true;
+      for (const auto& point : hull) {
+         if (glm::dot( planes[p], point ) >= 0.0f) {
+            outside = false;
+            break;
+         }
+      }
+      if (outside) return false;
+
+      // A bounded volume also stays in the union of the box and the influence sphere.
+      if (extrusion_radius > 0.0f &&
+          glm::dot( planes[p], glm::vec4(light, 1.0f) ) < -extrusion_radius * glm::length( glm::vec3(planes[p]) )) {
+         outside = true;
+         for (const auto& point : bounding_box) {
+            if (glm::dot( planes[p], glm::vec4(point, 1.0f) ) >= 0.0f) {
+               outside = false;
+               break;
+            }
+         }
+         if (outside) return false;
+      }
+   }
+   return true;
 }
 
-void RendererGL::drawLucyObject(ShaderGL* shader, const CameraGL* camera) const
+float RendererGL::getExtrusionRadius(int light_index) const
 {
-   const glm::mat4 to_world =
-      glm::translate( glm::mat4(1.0f), glm::vec3(100.0f, 200.0f, 30.0f) ) *
-      glm::rotate( glm::mat4(1.0f), glm::radians( 180.0f ), glm::vec3(0.0f, 0.0f, 1.0f) ) *
-      glm::rotate( glm::mat4(1.0f), glm::radians( 90.0f ), glm::vec3(1.0f, 0.0f, 0.0f) ) *
-      glm::scale( glm::mat4(1.0f), glm::vec3(0.35f, 0.35f, 0.35f) );
-   shader->transferBasicTransformationUniforms( to_world, camera );
+   // Only a bounded point light has an influence sphere, so the other lights always extrude to infinity.
+   if (!UseFiniteExtrusion || Lights->getLightPosition( light_index ).w == 0.0f) return 0.0f;
+   return Lights->isBounded( light_index ) ? Lights->getFallOffRadius( light_index ) : 0.0f;
+}
+
+bool RendererGL::isInOcclusionPyramid(const ObjectGL* caster, const glm::mat4& to_world, int light_index) const
+{
+   // The occlusion pyramid spans the light and the near plane rectangle. A caster outside of it cannot cast
+   // its volume over the near plane, so the stencil counts of the Z-pass algorithm start from zero correctly.
+   const glm::mat4 to_world_from_ndc = glm::inverse( MainCamera->getProjectionMatrix() * MainCamera->getViewMatrix() );
+   std::array<glm::vec3, 4> near_corners;
+   const std::array<glm::vec2, 4> ndc_corners = {
+      glm::vec2(-1.0f, -1.0f), glm::vec2(1.0f, -1.0f), glm::vec2(1.0f, 1.0f), glm::vec2(-1.0f, 1.0f)
+   };
+   glm::vec3 near_center(0.0f);
+   for (int i = 0; i < 4; ++i) {
+      const glm::vec4 corner = to_world_from_ndc * glm::vec4(ndc_corners[i], -1.0f, 1.0f);
+      near_corners[i] = glm::vec3(corner) / corner.w;
+      near_center += near_corners[i] * 0.25f;
+   }
+
+   const glm::vec4 light_position = Lights->getLightPosition( light_index );
+   const bool is_point_light = light_position.w != 0.0f;
+   const glm::vec3 light = is_point_light ? glm::vec3(light_position) / light_position.w : glm::vec3(light_position);
+   const glm::vec3 to_light = is_point_light ? light - near_center : light;
+   const glm::vec3 near_normal =
+      glm::normalize( glm::cross( near_corners[1] - near_corners[0], near_corners[3] - near_corners[0] ) );
+   if (std::abs( glm::dot( near_normal, to_light ) ) <= std::numeric_limits<float>::epsilon() * glm::length( to_light )) {
+      return true;
+   }
+
+   // Every plane is oriented so that a point inside of the pyramid is on its positive side.
+   const glm::vec3 inside = near_center + to_light * (is_point_light ? 0.25f : 1.0f);
+   std::array<glm::vec4, 5> planes;
+   const auto get_plane = [&inside](const glm::vec3& normal, const glm::vec3& point) {
+      const glm::vec4 plane(normal, -glm::dot( normal, point ));
+      return glm::dot( plane, glm::vec4(inside, 1.0f) ) < 0.0f ? -plane : plane;
+   };
+   planes[0] = get_plane( near_normal, near_center );
+   for (int i = 0; i < 4; ++i) {
+      const glm::vec3& a = near_corners[i];
+      const glm::vec3& b = near_corners[(i + 1) % 4];
+      planes[i + 1] = get_plane( glm::cross( b - a, is_point_light ? light - a : light ), a );
+   }
+
+   std::array<glm::vec3, 8> bounding_box;
+   getWorldBoundingBox( bounding_box, caster, to_world );
+   for (const auto& plane : planes) {
+      bool outside = true;
+      for (const auto& point : bounding_box) {
+         if (glm::dot( plane, glm::vec4(point, 1.0f) ) >= 0.0f) {
+            outside = false;
+            break;
+         }
+      }
+      if (outside) return false;
+   }
+   return true;
+}
+
+bool RendererGL::getLightBounds(glm::ivec4& scissor, glm::vec2& depth_bounds, int light_index) const
+{
+   // The bounds are taken from the falloff sphere, which the additive pass of the light does not reach beyond.
+   scissor = glm::ivec4(0, 0, FrameWidth, FrameHeight);
+   depth_bounds = glm::vec2(0.0f, 1.0f);
+   const glm::vec4 light_position = Lights->getLightPosition( light_index );
+   if (light_position.w == 0.0f || !Lights->isBounded( light_index )) return true;
+
+   const glm::mat4& projection = MainCamera->getProjectionMatrix();
+   const glm::vec3 center = glm::vec3(MainCamera->getViewMatrix() * (light_position / light_position.w));
+   const float radius = Lights->getFallOffRadius( light_index );
+   const float near_z = -MainCamera->getNearPlane();
+   const float far_z = -MainCamera->getFarPlane();
+   if (center.z - radius > near_z || center.z + radius < far_z) return false;
+
+   const auto get_depth = [&projection](float z) {
+      const glm::vec4 clip = projection * glm::vec4(0.0f, 0.0f, z, 1.0f);
+      return glm::clamp( clip.z / clip.w * 0.5f + 0.5f, 0.0f, 1.0f );
+   };
+   if (center.z - radius > far_z) depth_bounds.y = get_depth( center.z - radius );
+
+   // The sphere reaches the near plane, so its projection can cover the whole screen.
+   if (center.z + radius >= near_z) return true;
+
+   depth_bounds.x = get_depth( center.z + radius );
+   auto min_point = glm::vec2(std::numeric_limits<float>::max());
+   auto max_point = glm::vec2(std::numeric_limits<float>::lowest());
+   for (int i = 0; i < 8; ++i) {
+      const glm::vec3 corner = center + radius * glm::vec3(
+         (i & 1) ? 1.0f : -1.0f,
+         (i & 2) ? 1.0f : -1.0f,
+         (i & 4) ? 1.0f : -1.0f
+      );
+      const glm::vec4 clip = projection * glm::vec4(corner, 1.0f);
+      const glm::vec2 ndc = glm::vec2(clip) / clip.w;
+      min_point = glm::min( min_point, ndc );
+      max_point = glm::max( max_point, ndc );
+   }
+   min_point = glm::clamp( min_point, glm::vec2(-1.0f), glm::vec2(1.0f) );
+   max_point = glm::clamp( max_point, glm::vec2(-1.0f), glm::vec2(1.0f) );
+   if (min_point.x >= max_point.x || min_point.y >= max_point.y) return false;
+
+   const glm::vec2 frame_size(FrameWidth, FrameHeight);
+   const glm::ivec2 lower = glm::ivec2(glm::floor( (min_point * 0.5f + 0.5f) * frame_size ));
+   const glm::ivec2 upper = glm::ivec2(glm::ceil( (max_point * 0.5f + 0.5f) * frame_size ));
+   scissor = glm::ivec4(lower, upper - lower);
+   return true;
+}
+
+void RendererGL::drawBoxObject(ShaderGL* shader, const CameraGL* camera, bool use_position_stream) const
+{
+   // The walls are fetched with gl_DrawID from the static batch, so this costs the same for any number of them.
+   shader->transferBasicTransformationUniforms( glm::mat4(1.0f), camera );
+   StaticBatch->transferUniformsToShader( shader );
+   StaticBatch->draw( use_position_stream );
+}
+
+int RendererGL::prepareLucyObject(ShaderGL* shader, const CameraGL* camera, bool use_position_stream) const
+{
+   StateCacheGL& state = StateCacheGL::getInstance();
+   shader->transferBasicTransformationUniforms( LucyWorldMatrix, camera );
    LucyObject->transferUniformsToShader( shader );
 
-   glBindVertexArray( LucyObject->getVAO() );
-   if (!LucyObject->isAdjacencyMode()) glDrawArrays( LucyObject->getDrawMode(), 0, LucyObject->getVertexNum() );
+   // All the copies are drawn at once, fetching their transforms with gl_InstanceID.
+   const bool use_instancing = UseInstancing && LucyObject->getInstanceNum() > 0;
+   glUniform1i( shader->getInstancingLocation(), use_instancing ? 1 : 0 );
+   glUniform1i( shader->getDrawDataLocation(), 0 );
+   if (use_instancing) glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 4, LucyObject->getInstanceBuffer() );
+
+   state.bindVertexArray( use_position_stream ? LucyObject->getPositionVAO() : LucyObject->getVAO() );
+   return use_instancing ? LucyObject->getInstanceNum() : 1;
+}
+
+void RendererGL::drawLucyInstances(int first_instance, int instance_num) const
+{
+   if (!LucyObject->isIndexed()) {
+      glDrawArraysInstancedBaseInstance(
+         LucyObject->getDrawMode(), 0, LucyObject->getVertexNum(), instance_num, static_cast<GLuint>(first_instance)
+      );
+   }
    else {
-      glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, LucyObject->getIBO() );
-      glDrawElements( LucyObject->getDrawMode(), LucyObject->getIndexNum(), GL_UNSIGNED_INT, nullptr );
+      // Both vertex arrays own the index buffer, so it is not bound here.
+      glDrawElementsInstancedBaseInstance(
+         LucyObject->getDrawMode(), LucyObject->getIndexNum(), GL_UNSIGNED_INT, nullptr, instance_num,
+         static_cast<GLuint>(first_instance)
+      );
    }
 }
 
+void RendererGL::drawLucyObject(ShaderGL* shader, const CameraGL* camera, bool use_position_stream) const
+{
+   drawLucyInstances( 0, prepareLucyObject( shader, camera, use_position_stream ) );
+}
+
 void RendererGL::drawDepthMap() const
 {
-   glBindFramebuffer( GL_FRAMEBUFFER, 0 );
-   glDepthFunc( GL_LESS );
-   glDrawBuffer( GL_NONE );
-   glUseProgram( SceneShader->getShaderProgram() );
-   drawLucyObject( SceneShader.get(), MainCamera.get() );
-   drawBoxObject( SceneShader.get(), MainCamera.get() );
+   StateCacheGL& state = StateCacheGL::getInstance();
+   state.bindFramebuffer( MainFramebuffer );
+   state.depthFunc( GL_LESS );
+   state.drawBuffer( GL_NONE );
+
+   // Only the positions are fetched here, so the normals and texture coordinates do not cost any bandwidth.
+   state.useProgram( DepthShader->getShaderProgram() );
+   drawLucyObject( DepthShader.get(), MainCamera.get(), true );
+   drawBoxObject( DepthShader.get(), MainCamera.get(), true );
+}
+
+bool RendererGL::drawCachedLucyShadowVolume(
+   bool is_z_fail_algorithm,
+   bool robust,
+   int light_index,
+   const std::vector<int>& visible_instances
+) const
+{
+   StateCacheGL& state = StateCacheGL::getInstance();
+   const ShadowVolumeCacheGL::Key key{
+      LucyWorldMatrix, Lights->getLightPosition( light_index ), getExtrusionRadius( light_index ),
+      UseInstancing ? LucyObject->getInstanceNum() : 0, UseInstancing ? LucyObject->getInstanceVersion() : 0,
+      is_z_fail_algorithm, robust
+   };
+   ShadowVolumeCacheGL* cache = VolumeCaches[light_index * 2 + (is_z_fail_algorithm ? 1 : 0)].get();
+   if (!cache->lookUp( key )) {
+      if (!cache->isKeyStable()) return false;
+
+      // The capture camera has identity view and projection matrices, so the volume is captured in the world space.
+      // The view matrix is rigid, so the epsilon offsets of the geometry shader do not depend on the space.
+      state.useProgram( ShadowVolumeCaptureShader->getShaderProgram() );
+      ShadowVolumeCaptureShader->uniform4fv( "LightPosition", key.LightPosition );
+      ShadowVolumeCaptureShader->uniform1i( "Robust", robust ? 1 : 0 );
+      ShadowVolumeCaptureShader->uniform1i( "IsZFailAlgorithm", is_z_fail_algorithm ? 1 : 0 );
+      ShadowVolumeCaptureShader->uniform1f( "ExtrusionRadius", key.ExtrusionRadius );
+      const int instance_num = prepareLucyObject( ShadowVolumeCaptureShader.get(), CaptureCamera.get(), true );
+      do {
+         cache->beginCapture( instance_num );
+         for (int i = 0; i < instance_num; ++i) {
+            cache->beginInstance( i );
+            drawLucyInstances( i, 1 );
+            cache->endInstance();
+         }
+      } while (!cache->endCapture( key ));
+   }
+
+   state.useProgram( ShadowVolumeCPUShader->getShaderProgram() );
+   ShadowVolumeCPUShader->transferBasicTransformationUniforms( glm::mat4(1.0f), MainCamera.get() );
+   cache->draw( visible_instances );
+   return true;
+}
+
+void RendererGL::drawGeneratedLucyShadowVolume(
+   bool is_z_fail_algorithm,
+   bool robust,
+   int light_index,
+   const glm::mat4& to_world
+) const
+{
+   StateCacheGL& state = StateCacheGL::getInstance();
+
+   // The generator works in the object space, where the light is the same for any view.
+   const glm::mat3 model_view = glm::mat3(MainCamera->getViewMatrix() * to_world);
+   const float eye_scale = std::cbrt( std::abs( glm::determinant( model_view ) ) );
+   VolumeGenerator->generate(
+      glm::inverse( to_world ) * Lights->getLightPosition( light_index ),
+      eye_scale, getExtrusionRadius( light_index ) / eye_scale, is_z_fail_algorithm, robust,
+      ThreadPool::getInstance()
+   );
+
+   const std::vector<glm::vec4>& volume_vertices = VolumeGenerator->getVolumeVertices();
+   glNamedBufferData(
+      CPUVolumeBuffer,
+      static_cast<GLsizeiptr>(sizeof( glm::vec4 ) * volume_vertices.size()),
+      volume_vertices.data(),
+      GL_STREAM_DRAW
+   );
+   state.useProgram( ShadowVolumeCPUShader->getShaderProgram() );
+   ShadowVolumeCPUShader->transferBasicTransformationUniforms( to_world, MainCamera.get() );
+   state.bindVertexArray( CPUVolumeVAO );
+   glDrawArrays( GL_TRIANGLES, 0, static_cast<GLsizei>(volume_vertices.size()) );
 }
 
-void RendererGL::drawShadowVolumeWithZFail(bool robust) const
+void RendererGL::drawIndirectLucyShadowVolume(
+   bool is_z_fail_algorithm,
+   bool robust,
+   int light_index,
+   const glm::mat4& to_world
+) const
 {
+   StateCacheGL& state = StateCacheGL::getInstance();
+   const glm::vec4 light_position_in_eye = MainCamera->getViewMatrix() * Lights->getLightPosition( light_index );
+
+   // The compute pass appends the records of caps and silhouette quads, counting their vertices in the draw command.
+   const std::array<GLuint, 4> command = { 0, 1, 0, 0 };
+   glNamedBufferSubData( ShadowVolumeCommandBuffer, 0, sizeof( command ), command.data() );
+
+   const glm::mat4 model_view = MainCamera->getViewMatrix() * to_world * LucyObject->getDequantizationMatrix();
+   const int triangle_num = (LucyObject->isIndexed() ? LucyObject->getIndexNum() : LucyObject->getVertexNum()) / 6;
+   const int position_stride = LucyObject->getPositionStride() / static_cast<int>(sizeof( GLuint ));
+   const int use_compact_vertex = LucyObject->isCompactVertexFormat() ? 1 : 0;
+   const int use_indices = LucyObject->isIndexed() ? 1 : 0;
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, LucyObject->getPositionBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, LucyObject->getIBO() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, SilhouetteBuffer );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 3, ShadowVolumeCommandBuffer );
+
+   state.useProgram( SilhouetteShader->getShaderProgram() );
+   SilhouetteShader->uniformMat4fv( "ModelViewMatrix", model_view );
+   SilhouetteShader->uniform4fv( "LightPosition", light_position_in_eye );
+   SilhouetteShader->uniform1i( "Robust", robust ? 1 : 0 );
+   SilhouetteShader->uniform1i( "IsZFailAlgorithm", is_z_fail_algorithm ? 1 : 0 );
+   SilhouetteShader->uniform1f( "ExtrusionRadius", getExtrusionRadius( light_index ) );
+   SilhouetteShader->uniform1i( "TriangleNum", triangle_num );
+   SilhouetteShader->uniform1i( "PositionStride", position_stride );
+   SilhouetteShader->uniform1i( "UseCompactVertex", use_compact_vertex );
+   SilhouetteShader->uniform1i( "UseIndices", use_indices );
+   // At least 65535 groups are guaranteed in each dimension, so larger meshes take more than one row of groups.
+   constexpr int max_group_num = 65535;
+   const int group_num = (triangle_num + 63) / 64;
+   const int group_num_x = std::clamp( group_num, 1, max_group_num );
+   glDispatchCompute( group_num_x, (group_num + group_num_x - 1) / group_num_x, 1 );
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT );
+
+   state.useProgram( ShadowVolumeIndirectShader->getShaderProgram() );
+   ShadowVolumeIndirectShader->uniformMat4fv( "ModelViewMatrix", model_view );
+   ShadowVolumeIndirectShader->uniformMat4fv( "ProjectionMatrix", MainCamera->getProjectionMatrix() );
+   ShadowVolumeIndirectShader->uniform4fv( "LightPosition", light_position_in_eye );
+   ShadowVolumeIndirectShader->uniform1f( "ExtrusionRadius", getExtrusionRadius( light_index ) );
+   ShadowVolumeIndirectShader->uniform1i( "IsZFailAlgorithm", is_z_fail_algorithm ? 1 : 0 );
+   ShadowVolumeIndirectShader->uniform1i( "PositionStride", position_stride );
+   ShadowVolumeIndirectShader->uniform1i( "UseCompactVertex", use_compact_vertex );
+   ShadowVolumeIndirectShader->uniform1i( "UseIndices", use_indices );
+   state.bindVertexArray( ShadowVolumeVAO );
+   state.bindDrawIndirectBuffer( ShadowVolumeCommandBuffer );
+   glDrawArraysIndirect( GL_TRIANGLES, nullptr );
+}
+
+void RendererGL::drawLucyShadowVolume(
+   bool is_z_fail_algorithm,
+   bool robust,
+   int light_index,
+   const std::vector<int>& instances
+) const
+{
+   StateCacheGL& state = StateCacheGL::getInstance();
+   if (ShadowVolumeBackend == SHADOW_VOLUME_BACKEND::GEOMETRY_SHADER) {
+      if (UseShadowVolumeCache && drawCachedLucyShadowVolume( is_z_fail_algorithm, robust, light_index, instances )) {
+         return;
+      }
+
+      const glm::vec4 light_position_in_eye = MainCamera->getViewMatrix() * Lights->getLightPosition( light_index );
+      state.useProgram( ShadowVolumeShader->getShaderProgram() );
+      ShadowVolumeShader->uniform4fv( "LightPosition", light_position_in_eye );
+      ShadowVolumeShader->uniform1i( "Robust", robust ? 1 : 0 );
+      ShadowVolumeShader->uniform1i( "IsZFailAlgorithm", is_z_fail_algorithm ? 1 : 0 );
+      ShadowVolumeShader->uniform1f( "ExtrusionRadius", getExtrusionRadius( light_index ) );
+      prepareLucyObject( ShadowVolumeShader.get(), MainCamera.get(), true );
+
+      // Each run of consecutive instances is drawn at once.
+      for (size_t i = 0; i < instances.size();) {
+         size_t j = i + 1;
+         while (j < instances.size() && instances[j] == instances[j - 1] + 1) ++j;
+         drawLucyInstances( instances[i], static_cast<int>(j - i) );
+         i = j;
+      }
+      return;
+   }
+
+   // The other backends build the volume of each instance separately.
+   std::vector<glm::mat4> world_matrices;
+   getLucyWorldMatrices( world_matrices );
+   for (const int instance : instances) {
+      const glm::mat4& to_world = world_matrices[instance];
+      if (ShadowVolumeBackend == SHADOW_VOLUME_BACKEND::CPU) {
+         drawGeneratedLucyShadowVolume( is_z_fail_algorithm, robust, light_index, to_world );
+      }
+      else drawIndirectLucyShadowVolume( is_z_fail_algorithm, robust, light_index, to_world );
+   }
+}
+
+void RendererGL::drawShadowVolumeWithZFail(bool robust, int light_index, const std::vector<int>& instances) const
+{
+   StateCacheGL& state = StateCacheGL::getInstance();
+
    // Need to do the depth test, but do not write the result.
-   glDepthMask( GL_FALSE );
+   state.depthMask( GL_FALSE );
 
    // Do not near/far plane clipping due to projection-to-infinity.
-   glEnable( GL_DEPTH_CLAMP );
+   state.enable( GL_DEPTH_CLAMP );
 
    // All the front- or back-facing facets should be rendered to generate the shadow volume.
-   glDisable( GL_CULL_FACE );
+   state.disable( GL_CULL_FACE );
 
    // Only the depth test matters. (test order: stencil -> depth)
-   glStencilFunc( GL_ALWAYS, 0, ~0 );
+   state.stencilFunc( GL_ALWAYS, 0, ~0 );
 
-   glStencilOpSeparate( GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP );
-   glStencilOpSeparate( GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP );
+   state.stencilOpSeparate( GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP );
+   state.stencilOpSeparate( GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP );
 
-   glUseProgram( ShadowVolumeShader->getShaderProgram() );
-   const glm::vec4 light_position_in_eye = MainCamera->getViewMatrix() * Lights->getLightPosition( 0 );
-   ShadowVolumeShader->uniform4fv( "LightPosition", light_position_in_eye );
-   ShadowVolumeShader->uniform1i( "Robust", robust ? 1 : 0 );
-   ShadowVolumeShader->uniform1i( "IsZFailAlgorithm", 1 );
-   drawLucyObject( ShadowVolumeShader.get(), MainCamera.get() );
+   drawLucyShadowVolume( true, robust, light_index, instances );
 
-   glDepthMask( GL_TRUE );
-   glDisable( GL_DEPTH_CLAMP );
-   glEnable( GL_CULL_FACE );
+   state.depthMask( GL_TRUE );
+   state.disable( GL_DEPTH_CLAMP );
+   state.enable( GL_CULL_FACE );
 }
 
-void RendererGL::drawShadowVolumeWithZPass(bool robust) const
+void RendererGL::drawShadowVolumeWithZPass(bool robust, int light_index, const std::vector<int>& instances) const
 {
+   StateCacheGL& state = StateCacheGL::getInstance();
+
    // Need to do the depth test, but do not write the result.
-   glDepthMask( GL_FALSE );
+   state.depthMask( GL_FALSE );
 
    // Do not near/far plane clipping due to projection-to-infinity.
-   glEnable( GL_DEPTH_CLAMP );
+   state.enable( GL_DEPTH_CLAMP );
 
    // All the front- or back-facing facets should be rendered to generate the shadow volume.
-   glDisable( GL_CULL_FACE );
+   state.disable( GL_CULL_FACE );
 
    // Only the depth test matters. (test order: stencil -> depth)
-   glStencilFunc( GL_ALWAYS, 0, ~0 );
+   state.stencilFunc( GL_ALWAYS, 0, ~0 );
 
-   glStencilOpSeparate( GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP );
-   glStencilOpSeparate( GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP );
+   state.stencilOpSeparate( GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP );
+   state.stencilOpSeparate( GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP );
 
-   glUseProgram( ShadowVolumeShader->getShaderProgram() );
-   const glm::vec4 light_position_in_eye = MainCamera->getViewMatrix() * Lights->getLightPosition( 0 );
-   ShadowVolumeShader->uniform4fv( "LightPosition", light_position_in_eye );
-   ShadowVolumeShader->uniform1i( "Robust", robust ? 1 : 0 );
-   ShadowVolumeShader->uniform1i( "IsZFailAlgorithm", 0 );
-   drawLucyObject( ShadowVolumeShader.get(), MainCamera.get() );
+   drawLucyShadowVolume( false, robust, light_index, instances );
 
-   glDepthMask( GL_TRUE );
-   glDisable( GL_DEPTH_CLAMP );
-   glEnable( GL_CULL_FACE );
+   state.depthMask( GL_TRUE );
+   state.disable( GL_DEPTH_CLAMP );
+   state.enable( GL_CULL_FACE );
 }
 
-void RendererGL::drawShadow() const
+void RendererGL::drawCasterShadowVolumes(int light_index, int& z_pass_caster_num, int& z_fail_caster_num) const
 {
-   // GL_BACK is the initial value for double-buffered contexts.
-   glDrawBuffer( GL_BACK );
+   std::vector<glm::mat4> world_matrices;
+   getLucyWorldMatrices( world_matrices );
+
+   // Only the casters whose volume can be seen are drawn and counted.
+   std::vector<int> z_pass_instances, z_fail_instances;
+   for (int i = 0; i < static_cast<int>(world_matrices.size()); ++i) {
+      if (!isShadowVolumeVisible( LucyObject.get(), world_matrices[i], light_index )) continue;
+
+      bool is_z_fail_algorithm = AlgorithmToCompare == ALGORITHM_TO_COMPARE::Z_FAIL;
+      if (AlgorithmToCompare == ALGORITHM_TO_COMPARE::AUTOMATIC) {
+         // Z-fail is only needed when the near plane can be inside of the shadow volume of the caster.
+         is_z_fail_algorithm = isInOcclusionPyramid( LucyObject.get(), world_matrices[i], light_index );
+      }
+      if (is_z_fail_algorithm) z_fail_instances.emplace_back( i );
+      else z_pass_instances.emplace_back( i );
+   }
+
+   // Both algorithms count the volumes a pixel is inside of with the same sign, so their casters share the stencil.
+   if (!z_fail_instances.empty()) drawShadowVolumeWithZFail( Robust, light_index, z_fail_instances );
+   if (!z_pass_instances.empty()) drawShadowVolumeWithZPass( Robust, light_index, z_pass_instances );
+   z_fail_caster_num += static_cast<int>(z_fail_instances.size());
+   z_pass_caster_num += static_cast<int>(z_pass_instances.size());
+}
+
+void RendererGL::drawShadowVolume(int light_index, int& z_pass_caster_num, int& z_fail_caster_num) const
+{
+   Profiler->begin( static_cast<int>(RENDER_PASS::SHADOW_VOLUME) );
+   drawCasterShadowVolumes( light_index, z_pass_caster_num, z_fail_caster_num );
+   Profiler->end( static_cast<int>(RENDER_PASS::SHADOW_VOLUME) );
+}
+
+void RendererGL::drawShadow(int light_index, int lighting_pass) const
+{
+   StateCacheGL& state = StateCacheGL::getInstance();
+
+   // GL_BACK of the window, or the color attachment of the offscreen framebuffer in the headless mode
+   state.drawBuffer( MainDrawBuffer );
 
-   glStencilFunc( GL_EQUAL, 0, 0xFF );
-   glStencilOpSeparate( GL_FRONT_AND_BACK, GL_KEEP, GL_KEEP, GL_KEEP );
+   state.stencilFunc( GL_EQUAL, 0, 0xFF );
+   state.stencilOpSeparate( GL_FRONT_AND_BACK, GL_KEEP, GL_KEEP, GL_KEEP );
 
-   glDepthFunc( GL_LEQUAL );
+   state.depthFunc( GL_LEQUAL );
 
-   glUseProgram( SceneShader->getShaderProgram() );
-   Lights->transferUniformsToShader( SceneShader.get() );
-   SceneShader->uniform1i( "LightIndex", ActiveLightIndex );
+   Profiler->begin( static_cast<int>(RENDER_PASS::SHADING) );
+   state.useProgram( SceneShader->getShaderProgram() );
+   Lights->bindUniformBuffer( ShaderGL::LightBlockBinding );
+   SceneShader->uniform1i( "LightIndex", light_index );
+   SceneShader->uniform1i( "LightingPass", lighting_pass );
    SceneShader->uniform1i( "UseTexture", 0 );
    drawLucyObject( SceneShader.get(), MainCamera.get() );
    drawBoxObject( SceneShader.get(), MainCamera.get() );
+   Profiler->end( static_cast<int>(RENDER_PASS::SHADING) );
+}
+
+void RendererGL::drawShadowWithMultipleLights(int& z_pass_caster_num, int& z_fail_caster_num) const
+{
+   StateCacheGL& state = StateCacheGL::getInstance();
+   state.disable( GL_STENCIL_TEST );
+   drawShadow( ActiveLightIndex, 1 );
+
+   // Every light adds its contribution where the stencil of its own volumes stays zero.
+   state.enable( GL_BLEND );
+   state.blendFunc( GL_ONE, GL_ONE );
+   state.enable( GL_SCISSOR_TEST );
+   if (DepthBounds != nullptr) state.enable( GL_DEPTH_BOUNDS_TEST_EXT );
+   for (int i = 0; i < Lights->getTotalLightNum(); ++i) {
+      if (!Lights->isLightActivated( i )) continue;
+
+      glm::ivec4 scissor;
+      glm::vec2 depth_bounds;
+      if (!getLightBounds( scissor, depth_bounds, i )) continue;
+
+      // The stencil clear, the volumes and the lit pixels are all limited to the footprint of the light.
+      state.scissor( scissor.x, scissor.y, scissor.z, scissor.w );
+      if (DepthBounds != nullptr) DepthBounds( depth_bounds.x, depth_bounds.y );
+      glClear( GL_STENCIL_BUFFER_BIT );
+
+      state.enable( GL_STENCIL_TEST );
+      state.drawBuffer( GL_NONE );
+      drawShadowVolume( i, z_pass_caster_num, z_fail_caster_num );
+      drawShadow( i, 2 );
+      state.disable( GL_STENCIL_TEST );
+   }
+   if (DepthBounds != nullptr) state.disable( GL_DEPTH_BOUNDS_TEST_EXT );
+   state.disable( GL_SCISSOR_TEST );
+   state.disable( GL_BLEND );
+}
+
+void RendererGL::drawShadowWithMask(int& z_pass_caster_num, int& z_fail_caster_num) const
+{
+   StateCacheGL& state = StateCacheGL::getInstance();
+   state.enable( GL_STENCIL_TEST );
+   if (ShadowMask->isReferenceFrame()) {
+      // The full-resolution volumes are drawn only to measure them, and their stencil is not used.
+      // They are left out of the profiler passes, so that every 64th frame does not look slower.
+      int z_pass_num = 0;
+      int z_fail_num = 0;
+      ShadowMask->beginTiming( ShadowMaskGL::VOLUME_PASS::FULL_RESOLUTION );
+      drawCasterShadowVolumes( 0, z_pass_num, z_fail_num );
+      ShadowMask->endTiming( ShadowMaskGL::VOLUME_PASS::FULL_RESOLUTION );
+   }
+   ShadowMask->nextFrame();
+
+   ShadowMask->beginVolumePass();
+   ShadowMask->beginTiming( ShadowMaskGL::VOLUME_PASS::REDUCED_RESOLUTION );
+   drawShadowVolume( 0, z_pass_caster_num, z_fail_caster_num );
+   ShadowMask->endTiming( ShadowMaskGL::VOLUME_PASS::REDUCED_RESOLUTION );
+   ShadowMask->resolve( ShadowMaskShader.get() );
+   state.disable( GL_STENCIL_TEST );
+
+   // The shadow is applied by the mask, so every pixel is shaded without the stencil test.
+   ShadowMask->bindTextures();
+   SceneShader->uniform1i( "UseShadowMask", 1 );
+   SceneShader->uniform1i( "ShadowMaskScale", ShadowMask->getScale() );
+   drawShadow( ActiveLightIndex, 0 );
+   SceneShader->uniform1i( "UseShadowMask", 0 );
 }
 
 void RendererGL::drawText(const std::string& text, glm::vec2 start_position) const
 {
+   StateCacheGL& state = StateCacheGL::getInstance();
    std::vector<TextGL::Glyph*> glyphs;
    Texter->getGlyphsFromText( glyphs, text );
 
-   glViewport( 0, 0, FrameWidth, FrameHeight );
-   glBindFramebuffer( GL_FRAMEBUFFER, 0 );
-   glUseProgram( TextShader->getShaderProgram() );
+   state.viewport( 0, 0, FrameWidth, FrameHeight );
+   state.bindFramebuffer( MainFramebuffer );
+   state.useProgram( TextShader->getShaderProgram() );
 
-   glEnable( GL_BLEND );
-   glBlendFunc( GL_SRC_ALPHA, GL_ONE );
-   glDisable( GL_DEPTH_TEST );
+   state.enable( GL_BLEND );
+   state.blendFunc( GL_SRC_ALPHA, GL_ONE );
+   state.disable( GL_DEPTH_TEST );
 
    glm::vec2 text_position = start_position;
    const ObjectGL* glyph_object = Texter->getGlyphObject();
-   glBindVertexArray( glyph_object->getVAO() );
+   state.bindVertexArray( glyph_object->getVAO() );
    for (const auto& glyph : glyphs) {
       if (glyph->IsNewLine) {
          text_position.x = start_position.x;
@@ -464,54 +1303,372 @@ void RendererGL::drawText(const std::string& text, glm::vec2 start_position) con
       text_position.x += glyph->Advance.x;
       text_position.y -= glyph->Advance.y;
    }
-   glEnable( GL_DEPTH_TEST );
-   glDisable( GL_BLEND );
+   state.enable( GL_DEPTH_TEST );
+   state.disable( GL_BLEND );
 }
 
 void RendererGL::render() const
 {
+   StateCacheGL& state = StateCacheGL::getInstance();
+   TransformBufferGL& transforms = TransformBufferGL::getInstance();
+   state.beginFrame();
+   transforms.beginFrame();
+   Profiler->beginFrame();
    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
 
-   std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
-
-   glViewport( 0, 0, FrameWidth, FrameHeight );
+   state.viewport( 0, 0, FrameWidth, FrameHeight );
+   Profiler->begin( static_cast<int>(RENDER_PASS::DEPTH_PREPASS) );
    drawDepthMap();
-   glEnable( GL_STENCIL_TEST );
-   switch (AlgorithmToCompare) {
-      case ALGORITHM_TO_COMPARE::Z_FAIL: drawShadowVolumeWithZFail( Robust ); break;
-      case ALGORITHM_TO_COMPARE::Z_PASS: drawShadowVolumeWithZPass( Robust ); break;
+   Profiler->end( static_cast<int>(RENDER_PASS::DEPTH_PREPASS) );
+   int z_fail_caster_num = 0;
+   int z_pass_caster_num = 0;
+   if (UseMultipleLights) drawShadowWithMultipleLights( z_pass_caster_num, z_fail_caster_num );
+   else if (ShadowMask->isEnabled()) drawShadowWithMask( z_pass_caster_num, z_fail_caster_num );
+   else {
+      state.enable( GL_STENCIL_TEST );
+      drawShadowVolume( 0, z_pass_caster_num, z_fail_caster_num );
+      drawShadow( ActiveLightIndex, 0 );
+      state.disable( GL_STENCIL_TEST );
    }
-   drawShadow();
-   glDisable( GL_STENCIL_TEST );
-
-   std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
-   const auto fps = 1E+6 / static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
 
    std::stringstream text;
+   if (UseInstancing) text << LucyObject->getInstanceNum() << " Instances, ";
+   if (UseMultipleLights) text << Lights->getTotalLightNum() << " Lights, ";
+   if (UseFiniteExtrusion) text << "Finite Extrusion, ";
    if (Robust) text << "Robust ";
-   if (AlgorithmToCompare == ALGORITHM_TO_COMPARE::Z_FAIL) text << "Z-Fail Algorithm: ";
-   else text << "Z-Pass Algorithm: ";
-   text << std::fixed << std::setprecision( 2 ) << fps << " fps";
-   drawText( text.str(), { 80.0f, 50.0f } );
+   switch (AlgorithmToCompare) {
+      case ALGORITHM_TO_COMPARE::Z_FAIL: text << "Z-Fail Algorithm: "; break;
+      case ALGORITHM_TO_COMPARE::Z_PASS: text << "Z-Pass Algorithm: "; break;
+      case ALGORITHM_TO_COMPARE::AUTOMATIC:
+         text << "Automatic Algorithm (Z-Pass: " << z_pass_caster_num << ", Z-Fail: " << z_fail_caster_num << "): ";
+         break;
+   }
+   text << std::fixed << std::setprecision( 2 ) << Profiler->getFrameTime() << " ms GPU";
+   switch (ShadowVolumeBackend) {
+      case SHADOW_VOLUME_BACKEND::GEOMETRY_SHADER:
+         text << " (Geometry Shader";
+         if (UseShadowVolumeCache) {
+            int look_up_num = 0;
+            int hit_num = 0;
+            for (const auto& cache : VolumeCaches) {
+               look_up_num += cache->getRecentLookUpNum();
+               hit_num += cache->getRecentHitNum();
+            }
+            const double hit_rate = look_up_num > 0 ? static_cast<double>(hit_num) / static_cast<double>(look_up_num) : 0.0;
+            text << ", Recent Cache Hit Rate: " << std::setprecision( 1 ) << hit_rate * 100.0 << "%";
+         }
+         text << ")";
+         break;
+      case SHADOW_VOLUME_BACKEND::COMPUTE_SHADER: text << " (Compute Shader)"; break;
+      case SHADOW_VOLUME_BACKEND::CPU:
+         text << " (CPU: " << std::setprecision( 1 ) << VolumeGenerator->getTrianglesPerSecondPerCore() * 1e-6
+            << " M triangles/s/core)";
+         break;
+   }
+   text << "\n";
+   for (int i = 0; i < Profiler->getPassNum(); ++i) {
+      text << (i > 0 ? ", " : "") << Profiler->getPassName( i ) << ": " << std::setprecision( 2 )
+         << Profiler->getPassTime( i ) << " ms";
+   }
+   text << " (State Calls: " << state.getIssuedCallNum() << " Issued, " << state.getDroppedCallNum() << " Dropped, "
+      << transforms.getWrittenSlotNum() << " Transforms)";
+   if (!UseMultipleLights && ShadowMask->isEnabled()) {
+      const double reduced_time = ShadowMask->getVolumePassTime( ShadowMaskGL::VOLUME_PASS::REDUCED_RESOLUTION );
+      const double full_time = ShadowMask->getVolumePassTime( ShadowMaskGL::VOLUME_PASS::FULL_RESOLUTION );
+      text << "\nShadow Mask 1/" << ShadowMask->getScale() << ": " << std::setprecision( 2 ) << reduced_time
+         << " ms, Full Resolution: " << full_time << " ms, Saved: " << full_time - reduced_time << " ms";
+   }
+   // The lines go downward from the start position.
+   const std::string hud = text.str();
+   const auto line_num = static_cast<float>(std::count( hud.begin(), hud.end(), '\n' ));
+   Profiler->begin( static_cast<int>(RENDER_PASS::TEXT) );
+   drawText( hud, { 80.0f, 50.0f + line_num * Texter->getFontSize() } );
+   Profiler->end( static_cast<int>(RENDER_PASS::TEXT) );
+   transforms.endFrame();
+
+   if (Profiler->getAveragedFrameNum() >= 256) Profiler->log( std::cout );
 }
 
-void RendererGL::play()
+std::string RendererGL::getVariantName() const
+{
+   std::stringstream name;
+   if (Robust) name << "Robust ";
+   switch (AlgorithmToCompare) {
+      case ALGORITHM_TO_COMPARE::Z_FAIL: name << "Z-Fail"; break;
+      case ALGORITHM_TO_COMPARE::Z_PASS: name << "Z-Pass"; break;
+      case ALGORITHM_TO_COMPARE::AUTOMATIC: name << "Automatic"; break;
+   }
+   switch (ShadowVolumeBackend) {
+      case SHADOW_VOLUME_BACKEND::GEOMETRY_SHADER: name << " (Geometry Shader"; break;
+      case SHADOW_VOLUME_BACKEND::COMPUTE_SHADER: name << " (Compute Shader"; break;
+      case SHADOW_VOLUME_BACKEND::CPU: name << " (CPU"; break;
+   }
+   if (UseShadowVolumeCache && ShadowVolumeBackend == SHADOW_VOLUME_BACKEND::GEOMETRY_SHADER) name << ", Cache";
+   if (UseMultipleLights) name << ", " << Lights->getTotalLightNum() << " Lights";
+   else if (ShadowMask->isEnabled()) name << ", Shadow Mask 1/" << ShadowMask->getScale();
+   if (UseInstancing) name << ", " << LucyObject->getInstanceNum() << " Instances";
+   name << ")";
+   return name.str();
+}
+
+void RendererGL::recordFrame(double cpu_frame_time, double swap_interval) const
+{
+   FrameStatistics::Frame frame;
+   frame.Variant = Statistics->getVariantIndex( getVariantName() );
+   frame.CPUFrameTime = cpu_frame_time;
+   frame.SwapInterval = swap_interval;
+   Statistics->submit( Profiler->getFrameId(), frame );
+   resolveGPUTimes( false );
+}
+
+void RendererGL::resolveGPUTimes(bool wait) const
+{
+   if (wait) Profiler->flush();
+
+   uint64_t frame_id;
+   std::vector<double> pass_times;
+   while (Profiler->popResolvedFrame( frame_id, pass_times )) Statistics->resolve( frame_id, pass_times );
+   if (wait) Statistics->flushPending();
+}
+
+void RendererGL::writeFrameStatistics() const
 {
-   if (glfwWindowShouldClose( Window )) initialize();
+   resolveGPUTimes( true );
+
+   std::vector<FrameStatistics::Frame> frames;
+   Statistics->getSnapshot( frames );
+   if (frames.empty()) return;
+
+   const int gpu_total = Statistics->getMetricNum() - 1;
+   const FrameStatistics::Summary cpu = Statistics->summarize( frames, 0 );
+   const FrameStatistics::Summary gpu = Statistics->summarize( frames, gpu_total );
+   std::cout << std::fixed << std::setprecision( 3 ) << frames.size() << " Frames, CPU: mean " << cpu.Mean
+      << " / p50 " << cpu.P50 << " / p95 " << cpu.P95 << " / p99 " << cpu.P99 << " / max " << cpu.Max << " ms, "
+      << "GPU: mean " << gpu.Mean << " / p50 " << gpu.P50 << " / p95 " << gpu.P95 << " / p99 " << gpu.P99
+      << " / max " << gpu.Max << " ms\n";
+   if (Statistics->writeCSV( "../frame_statistics.csv" ) && Statistics->writeJSON( "../frame_statistics.json" )) {
+      std::cout << "Frame Statistics Written\n";
+   }
+}
 
+void RendererGL::prepareScene()
+{
    setLights();
    setWallObject();
    setLucyObject();
+   setLucyInstances();
+   prepareSilhouetteBuffers();
 
    TextShader->setTextUniformLocations();
-   SceneShader->setSceneUniformLocations( 1 );
+   SceneShader->setSceneUniformLocations();
    ShadowVolumeShader->setShadowVolumeUniformLocations();
+   ShadowVolumeCaptureShader->setShadowVolumeUniformLocations();
+   DepthShader->setDepthUniformLocations();
+   SilhouetteShader->setSilhouetteUniformLocations();
+   ShadowVolumeIndirectShader->setShadowVolumeIndirectUniformLocations();
+   ShadowVolumeCPUShader->setShadowVolumeCPUUniformLocations();
+   Profiler->initialize( { "Depth", "Volume", "Shading", "Text" } );
+   Statistics->initialize( 1 << 16, { "Depth", "Volume", "Shading", "Text" } );
+   SceneShader->uniform1i( "UseShadowMask", 0 );
+}
 
-   while (!glfwWindowShouldClose( Window )) {
-      if (!Pause) render();
+void RendererGL::releaseScene()
+{
+   releaseSilhouetteBuffers();
+   ShadowMask->release();
+   Profiler->release();
+   TransformBufferGL::getInstance().release();
+   if (Headless) {
+      releaseMainFramebuffer();
+      destroyHeadlessContext();
+   }
+   else {
+      glfwDestroyWindow( Window );
+      Window = nullptr;
+   }
+   Initialized = false;
+}
 
-      glfwSwapBuffers( Window );
-      glfwPollEvents();
+void RendererGL::resizeFrame(int width, int height)
+{
+   FrameWidth = width;
+   FrameHeight = height;
+   releaseMainFramebuffer();
+   prepareMainFramebuffer();
+   MainCamera->updatePerspectiveCamera( FrameWidth, FrameHeight );
+   TextCamera->update2DCamera( FrameWidth, FrameHeight );
+   if (ShadowMask->isEnabled()) {
+      ShadowMask->initialize(
+         FrameWidth, FrameHeight, ShadowMask->getScale(), MainFramebuffer, MainDepthStencilFormat
+      );
+   }
+}
+
+bool RendererGL::setDepthStencilFormat(GLenum format)
+{
+   if (format != GL_DEPTH24_STENCIL8 && format != GL_DEPTH32F_STENCIL8) {
+      std::cerr << "The depth-stencil format has no stencil: 0x" << std::hex << format << std::dec << "\n";
+      return false;
+   }
+   // The window has the 24-bit depth and 8-bit stencil requested when it is created.
+   if (!Headless && format != GL_DEPTH24_STENCIL8) {
+      std::cerr << "The window only supports the 24-bit depth and 8-bit stencil\n";
+      return false;
+   }
+
+   MainDepthStencilFormat = format;
+   if (Initialized && Headless) resizeFrame( FrameWidth, FrameHeight );
+   return true;
+}
+
+void RendererGL::play()
+{
+   // The context is released at the end of every run, so a later run creates it again.
+   if (!Initialized) Initialized = initialize();
+   if (!Initialized) return;
+
+   prepareScene();
+
+   using Clock = std::chrono::steady_clock;
+   const auto to_milliseconds = [](const Clock::time_point& start, const Clock::time_point& end) {
+      return std::chrono::duration<double, std::milli>(end - start).count();
+   };
+   auto last_swap = Clock::now();
+   if (Headless) {
+      for (int i = 0; i < HeadlessFrameNum; ++i) {
+         const auto start = Clock::now();
+         render();
+         const auto end = Clock::now();
+         recordFrame( to_milliseconds( start, end ), to_milliseconds( last_swap, end ) );
+         last_swap = end;
+      }
+      glFinish();
+      writeFrame( "../result.png" );
+      writeDepthTexture( "../depth.png" );
+      writeStencilTexture( "../stencil.png" );
+   }
+   else {
+      while (!glfwWindowShouldClose( Window )) {
+         const auto start = Clock::now();
+         if (!Pause) render();
+         const auto end = Clock::now();
+
+         glfwSwapBuffers( Window );
+         const auto swap = Clock::now();
+         if (!Pause) recordFrame( to_milliseconds( start, end ), to_milliseconds( last_swap, swap ) );
+         last_swap = swap;
+         glfwPollEvents();
+      }
+   }
+   writeFrameStatistics();
+   releaseScene();
+}
+
+void RendererGL::setBenchmarkPath(Benchmark& benchmark) const
+{
+   // The camera orbits the caster while the light circles the other way, so the volumes and their footprint change.
+   // The third keyframe puts the camera inside of the shadow volume of the caster, where Z-pass is wrong.
+   const glm::vec3 center(0.0f, 150.0f, 0.0f);
+   const glm::vec3 up(0.0f, 1.0f, 0.0f);
+   benchmark.addKeyframe(
+      { 0.0f, glm::vec3(500.0f, 750.0f, 400.0f), center, up, glm::vec4(500.0f, 500.0f, 500.0f, 1.0f) }
+   );
+   benchmark.addKeyframe(
+      { 0.25f, glm::vec3(-600.0f, 500.0f, 500.0f), center, up, glm::vec4(600.0f, 550.0f, -300.0f, 1.0f) }
+   );
+   benchmark.addKeyframe(
+      { 0.5f, glm::vec3(-150.0f, 120.0f, -200.0f), center, up, glm::vec4(500.0f, 600.0f, 400.0f, 1.0f) }
+   );
+   benchmark.addKeyframe(
+      { 0.75f, glm::vec3(300.0f, 400.0f, -700.0f), center, up, glm::vec4(-500.0f, 500.0f, 500.0f, 1.0f) }
+   );
+   benchmark.addKeyframe(
+      { 1.0f, glm::vec3(500.0f, 750.0f, 400.0f), center, up, glm::vec4(500.0f, 500.0f, 500.0f, 1.0f) }
+   );
+}
+
+bool RendererGL::benchmark(const std::string& baseline_path, double regression_threshold)
+{
+   if (!Headless) {
+      std::cerr << "The benchmark runs only in the headless mode\n";
+      return false;
+   }
+   if (!Initialized) Initialized = initialize();
+   if (!Initialized) return false;
+
+   prepareScene();
+
+   Benchmark path;
+   setBenchmarkPath( path );
+   const glm::vec4 light_position = Lights->getLightPosition( 0 );
+   // The cache is left out, so that the rows measure the algorithms rather than the replay of stable volumes.
+   const bool use_shadow_volume_cache = UseShadowVolumeCache;
+   UseShadowVolumeCache = false;
+   const std::array<glm::ivec2, 3> resolutions{ glm::ivec2(1280, 720), glm::ivec2(1920, 1080), glm::ivec2(2560, 1440) };
+   const std::array<ALGORITHM_TO_COMPARE, 2> algorithms{ ALGORITHM_TO_COMPARE::Z_FAIL, ALGORITHM_TO_COMPARE::Z_PASS };
+   for (const auto& resolution : resolutions) {
+      resizeFrame( resolution.x, resolution.y );
+      for (const auto& algorithm : algorithms) {
+         for (const bool robust : { true, false }) {
+            AlgorithmToCompare = algorithm;
+            Robust = robust;
+
+            constexpr int warm_up_frame_num = 8;
+            Benchmark::Keyframe keyframe = path.getKeyframe( 0.0f );
+            MainCamera->updateCameraView( keyframe.CameraPosition, keyframe.CameraReference, keyframe.CameraUp );
+            Lights->setLightPosition( keyframe.LightPosition, 0 );
+            for (int i = 0; i < warm_up_frame_num; ++i) render();
+
+            Statistics->clear();
+            auto last_frame_end = std::chrono::steady_clock::now();
+            for (int i = 0; i < HeadlessFrameNum; ++i) {
+               const auto start = std::chrono::steady_clock::now();
+               keyframe = path.getKeyframe(
+                  static_cast<float>(i) / static_cast<float>(std::max( HeadlessFrameNum - 1, 1 ))
+               );
+               MainCamera->updateCameraView( keyframe.CameraPosition, keyframe.CameraReference, keyframe.CameraUp );
+               Lights->setLightPosition( keyframe.LightPosition, 0 );
+               render();
+               const auto end = std::chrono::steady_clock::now();
+               // There is no swap in the headless context, so the interval is taken between the ends of the frames.
+               recordFrame(
+                  std::chrono::duration<double, std::milli>(end - start).count(),
+                  std::chrono::duration<double, std::milli>(end - last_frame_end).count()
+               );
+               last_frame_end = end;
+            }
+            resolveGPUTimes( true );
+
+            std::vector<FrameStatistics::Frame> frames;
+            Statistics->getSnapshot( frames );
+            const FrameStatistics::Summary cpu = Statistics->summarize( frames, 0 );
+            const FrameStatistics::Summary gpu = Statistics->summarize( frames, Statistics->getMetricNum() - 1 );
+            Benchmark::Result result;
+            result.Variant = getVariantName();
+            result.Width = FrameWidth;
+            result.Height = FrameHeight;
+            result.FrameNum = static_cast<int>(frames.size());
+            result.CPUMean = cpu.Mean;
+            result.GPUMean = gpu.Mean;
+            result.GPUP50 = gpu.P50;
+            result.GPUP95 = gpu.P95;
+            result.GPUP99 = gpu.P99;
+            result.GPUMax = gpu.Max;
+            path.addResult( result );
+            std::cout << result.Variant << " " << result.Width << "x" << result.Height << ": GPU p50 "
+               << std::fixed << std::setprecision( 3 ) << result.GPUP50 << " ms, p99 " << result.GPUP99 << " ms\n";
+         }
+      }
+   }
+   Lights->setLightPosition( light_position, 0 );
+   UseShadowVolumeCache = use_shadow_volume_cache;
+
+   bool passed = path.writeReport( "../benchmark.csv" );
+   if (!baseline_path.empty()) {
+      const int regression_num = path.compareWithBaseline( baseline_path, regression_threshold, std::cout );
+      if (regression_num >= 0) std::cout << regression_num << " Regressions beyond " << regression_threshold << "%\n";
+      passed = passed && regression_num == 0;
    }
-   glfwDestroyWindow( Window );
+   releaseScene();
+   return passed;
 }
\ No newline at end of file
@@ -111,12 +111,25 @@ void ShaderGL::setComputeShaders(const char* compute_shader_path)
    glDeleteShader( compute_shader );
 }
 
+void ShaderGL::setTransformFeedbackVaryings(const std::vector<const char*>& varyings) const
+{
+   glTransformFeedbackVaryings(
+      ShaderProgram, static_cast<GLsizei>(varyings.size()), varyings.data(), GL_INTERLEAVED_ATTRIBS
+   );
+   glLinkProgram( ShaderProgram );
+}
+
 void ShaderGL::setBasicTransformationUniforms()
 {
    Location.World = glGetUniformLocation( ShaderProgram, "WorldMatrix" );
    Location.View = glGetUniformLocation( ShaderProgram, "ViewMatrix" );
    Location.Projection = glGetUniformLocation( ShaderProgram, "ProjectionMatrix" );
    Location.ModelViewProjection = glGetUniformLocation( ShaderProgram, "ModelViewProjectionMatrix" );
+   Location.TransformBlock = static_cast<GLint>(glGetUniformBlockIndex( ShaderProgram, "Transform" ));
+   Location.Dequantization = glGetUniformLocation( ShaderProgram, "DequantizationMatrix" );
+   Location.UseCompactVertex = glGetUniformLocation( ShaderProgram, "UseCompactVertex" );
+   Location.UseInstancing = glGetUniformLocation( ShaderProgram, "UseInstancing" );
+   Location.UseDrawData = glGetUniformLocation( ShaderProgram, "UseDrawData" );
 }
 
 void ShaderGL::setTextUniformLocations()
@@ -132,9 +145,45 @@ void ShaderGL::setShadowVolumeUniformLocations()
    addUniformLocation( "LightPosition" );
    addUniformLocation( "Robust" );
    addUniformLocation( "IsZFailAlgorithm" );
+   addUniformLocation( "ExtrusionRadius" );
+}
+
+void ShaderGL::setSilhouetteUniformLocations()
+{
+   addUniformLocation( "ModelViewMatrix" );
+   addUniformLocation( "LightPosition" );
+   addUniformLocation( "Robust" );
+   addUniformLocation( "IsZFailAlgorithm" );
+   addUniformLocation( "ExtrusionRadius" );
+   addUniformLocation( "TriangleNum" );
+   addUniformLocation( "PositionStride" );
+   addUniformLocation( "UseCompactVertex" );
+   addUniformLocation( "UseIndices" );
 }
 
-void ShaderGL::setSceneUniformLocations(int light_num)
+void ShaderGL::setShadowVolumeIndirectUniformLocations()
+{
+   addUniformLocation( "ModelViewMatrix" );
+   addUniformLocation( "ProjectionMatrix" );
+   addUniformLocation( "LightPosition" );
+   addUniformLocation( "ExtrusionRadius" );
+   addUniformLocation( "IsZFailAlgorithm" );
+   addUniformLocation( "PositionStride" );
+   addUniformLocation( "UseCompactVertex" );
+   addUniformLocation( "UseIndices" );
+}
+
+void ShaderGL::setShadowVolumeCPUUniformLocations()
+{
+   setBasicTransformationUniforms();
+}
+
+void ShaderGL::setDepthUniformLocations()
+{
+   setBasicTransformationUniforms();
+}
+
+void ShaderGL::setSceneUniformLocations()
 {
    setBasicTransformationUniforms();
 
@@ -146,36 +195,29 @@ void ShaderGL::setSceneUniformLocations(int light_num)
 
    Location.Texture[0] = glGetUniformLocation( ShaderProgram, "BaseTexture" );
 
-   Location.UseLight = glGetUniformLocation( ShaderProgram, "UseLight" );
-   Location.LightNum = glGetUniformLocation( ShaderProgram, "LightNum" );
-   Location.GlobalAmbient = glGetUniformLocation( ShaderProgram, "GlobalAmbient" );
-
-   Location.Lights.resize( light_num );
-   for (int i = 0; i < light_num; ++i) {
-      Location.Lights[i].LightSwitch = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].LightSwitch").c_str() );
-      Location.Lights[i].LightPosition = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].Position").c_str() );
-      Location.Lights[i].LightAmbient = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].AmbientColor").c_str() );
-      Location.Lights[i].LightDiffuse = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].DiffuseColor").c_str() );
-      Location.Lights[i].LightSpecular = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].SpecularColor").c_str() );
-      Location.Lights[i].SpotlightDirection = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].SpotlightDirection").c_str() );
-      Location.Lights[i].SpotlightCutoffAngle = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].SpotlightCutoffAngle").c_str() );
-      Location.Lights[i].SpotlightFeather = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].SpotlightFeather").c_str() );
-      Location.Lights[i].LightFallOffRadius = glGetUniformLocation( ShaderProgram, std::string("Lights[" + std::to_string( i ) + "].FallOffRadius").c_str() );
-   }
-
    addUniformLocation( "UseTexture" );
    addUniformLocation( "LightIndex" );
+   addUniformLocation( "LightingPass" );
+   addUniformLocation( "UseShadowMask" );
+   addUniformLocation( "ShadowMaskScale" );
 }
 
 void ShaderGL::transferBasicTransformationUniforms(const glm::mat4& to_world, const CameraGL* camera) const
 {
-   const glm::mat4 view = camera->getViewMatrix();
-   const glm::mat4 projection = camera->getProjectionMatrix();
-   const glm::mat4 model_view_projection = projection * view * to_world;
-   glUniformMatrix4fv( Location.World, 1, GL_FALSE, &to_world[0][0] );
-   glUniformMatrix4fv( Location.View, 1, GL_FALSE, &view[0][0] );
-   glUniformMatrix4fv( Location.Projection, 1, GL_FALSE, &projection[0][0] );
-   glUniformMatrix4fv( Location.ModelViewProjection, 1, GL_FALSE, &model_view_projection[0][0] );
+   if (Location.TransformBlock >= 0) {
+      // The programs with the transform block read the camera block as well.
+      camera->bindUniformBuffer( CameraBlockBinding );
+      TransformBufferGL::getInstance().bind( TransformBlockBinding, to_world, camera );
+   }
+   else {
+      const glm::mat4 view = camera->getViewMatrix();
+      const glm::mat4 projection = camera->getProjectionMatrix();
+      const glm::mat4 model_view_projection = projection * view * to_world;
+      glUniformMatrix4fv( Location.World, 1, GL_FALSE, &to_world[0][0] );
+      glUniformMatrix4fv( Location.View, 1, GL_FALSE, &view[0][0] );
+      glUniformMatrix4fv( Location.Projection, 1, GL_FALSE, &projection[0][0] );
+      glUniformMatrix4fv( Location.ModelViewProjection, 1, GL_FALSE, &model_view_projection[0][0] );
+   }
 
    for (const auto& texture : Location.Texture) {
       glUniform1i( texture.second, texture.first );
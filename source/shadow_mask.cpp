@@ -0,0 +1,145 @@
+#include "shadow_mask.h"
+
+ShadowMaskGL::ShadowMaskGL() :
+   Scale( 1 ), FrameWidth( 0 ), FrameHeight( 0 ), MaskWidth( 0 ), MaskHeight( 0 ), FrameNum( 0 ), MainFramebuffer( 0 ), FBO( 0 ),
+   MaskTexture( 0 ), DepthStencilTexture( 0 ), EmptyVAO( 0 ), TimerQueries(), IsQueryIssued(), QueryIndices(),
+   VolumePassTimes()
+{
+}
+
+ShadowMaskGL::~ShadowMaskGL()
+{
+   release();
+}
+
+void ShadowMaskGL::release()
+{
+   if (FBO != 0) glDeleteFramebuffers( 1, &FBO );
+   if (MaskTexture != 0) glDeleteTextures( 1, &MaskTexture );
+   if (DepthStencilTexture != 0) glDeleteTextures( 1, &DepthStencilTexture );
+   if (EmptyVAO != 0) glDeleteVertexArrays( 1, &EmptyVAO );
+   for (auto& queries : TimerQueries) {
+      if (queries[0] != 0) glDeleteQueries( 2, queries.data() );
+      queries = { 0, 0 };
+   }
+   FBO = 0;
+   MaskTexture = 0;
+   DepthStencilTexture = 0;
+   EmptyVAO = 0;
+   Scale = 1;
+   IsQueryIssued = {};
+   QueryIndices = {};
+   VolumePassTimes = {};
+   StateCacheGL::getInstance().invalidate();
+}
+
+void ShadowMaskGL::initialize(
+   int frame_width,
+   int frame_height,
+   int scale,
+   GLuint main_framebuffer,
+   GLenum depth_stencil_format
+)
+{
+   release();
+   if (scale <= 1) return;
+
+   Scale = scale;
+   FrameWidth = frame_width;
+   FrameHeight = frame_height;
+   MaskWidth = std::max( frame_width / scale, 1 );
+   MaskHeight = std::max( frame_height / scale, 1 );
+   FrameNum = 0;
+   MainFramebuffer = main_framebuffer;
+
+   glCreateTextures( GL_TEXTURE_2D, 1, &MaskTexture );
+   glTextureStorage2D( MaskTexture, 1, GL_R8, MaskWidth, MaskHeight );
+   glTextureParameteri( MaskTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+   glTextureParameteri( MaskTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+   glTextureParameteri( MaskTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+   glTextureParameteri( MaskTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+   // The format matches the main framebuffer, so that the depth can be copied with a blit.
+   glCreateTextures( GL_TEXTURE_2D, 1, &DepthStencilTexture );
+   glTextureStorage2D( DepthStencilTexture, 1, depth_stencil_format, MaskWidth, MaskHeight );
+   glTextureParameteri( DepthStencilTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+   glTextureParameteri( DepthStencilTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+   glTextureParameteri( DepthStencilTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+   glTextureParameteri( DepthStencilTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+   glTextureParameteri( DepthStencilTexture, GL_DEPTH_STENCIL_TEXTURE_MODE, GL_DEPTH_COMPONENT );
+
+   glCreateFramebuffers( 1, &FBO );
+   glNamedFramebufferTexture( FBO, GL_COLOR_ATTACHMENT0, MaskTexture, 0 );
+   glNamedFramebufferTexture( FBO, GL_DEPTH_STENCIL_ATTACHMENT, DepthStencilTexture, 0 );
+   if (glCheckNamedFramebufferStatus( FBO, GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cerr << "Shadow mask framebuffer is not complete\n";
+   }
+
+   // The full-screen triangle of the resolve pass is generated from gl_VertexID.
+   glCreateVertexArrays( 1, &EmptyVAO );
+
+   for (auto& queries : TimerQueries) glCreateQueries( GL_TIME_ELAPSED, 2, queries.data() );
+}
+
+void ShadowMaskGL::beginVolumePass() const
+{
+   // The nearest sample keeps an actual depth of the prepass instead of averaging across the silhouettes.
+   glBlitNamedFramebuffer(
+      MainFramebuffer, FBO,
+      0, 0, FrameWidth, FrameHeight,
+      0, 0, MaskWidth, MaskHeight,
+      GL_DEPTH_BUFFER_BIT, GL_NEAREST
+   );
+
+   StateCacheGL& state = StateCacheGL::getInstance();
+   state.bindFramebuffer( FBO );
+   state.viewport( 0, 0, MaskWidth, MaskHeight );
+   state.drawBuffer( GL_NONE );
+   glClear( GL_STENCIL_BUFFER_BIT );
+}
+
+void ShadowMaskGL::resolve(const ShaderGL* resolve_shader) const
+{
+   StateCacheGL& state = StateCacheGL::getInstance();
+   constexpr std::array<GLfloat, 4> lit{ 0.0f, 0.0f, 0.0f, 0.0f };
+   state.drawBuffer( GL_COLOR_ATTACHMENT0 );
+   glClearBufferfv( GL_COLOR, 0, lit.data() );
+
+   state.stencilFunc( GL_NOTEQUAL, 0, 0xFF );
+   state.stencilOpSeparate( GL_FRONT_AND_BACK, GL_KEEP, GL_KEEP, GL_KEEP );
+   state.disable( GL_DEPTH_TEST );
+
+   state.useProgram( resolve_shader->getShaderProgram() );
+   state.bindVertexArray( EmptyVAO );
+   glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+   state.enable( GL_DEPTH_TEST );
+   state.bindFramebuffer( MainFramebuffer );
+   state.viewport( 0, 0, FrameWidth, FrameHeight );
+}
+
+void ShadowMaskGL::bindTextures() const
+{
+   glBindTextureUnit( 1, MaskTexture );
+   glBindTextureUnit( 2, DepthStencilTexture );
+}
+
+void ShadowMaskGL::beginTiming(VOLUME_PASS pass)
+{
+   const auto p = static_cast<int>(pass);
+   const int q = QueryIndices[p];
+   if (IsQueryIssued[p][q]) {
+      GLuint64 elapsed_time = 0;
+      glGetQueryObjectui64v( TimerQueries[p][q], GL_QUERY_RESULT, &elapsed_time );
+      VolumePassTimes[p] = static_cast<double>(elapsed_time) * 1e-6;
+   }
+   glBeginQuery( GL_TIME_ELAPSED, TimerQueries[p][q] );
+}
+
+void ShadowMaskGL::endTiming(VOLUME_PASS pass)
+{
+   const auto p = static_cast<int>(pass);
+   glEndQuery( GL_TIME_ELAPSED );
+   IsQueryIssued[p][QueryIndices[p]] = true;
+   QueryIndices[p] ^= 1;
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "shadow_volume_cache.h"
+
+ShadowVolumeCacheGL::ShadowVolumeCacheGL() :
+   IsValid( false ), CachedKey(), MissedKey(), StableLookUpNum( 0 ), TransformFeedback( 0 ), VolumeBuffer( 0 ), VAO( 0 ),
+   OverflowQuery( 0 ), TriangleCapacity( 0 ), RecentLookUpNum( 0 )
+{
+}
+
+ShadowVolumeCacheGL::~ShadowVolumeCacheGL()
+{
+   release();
+}
+
+void ShadowVolumeCacheGL::release()
+{
+   if (TransformFeedback != 0) glDeleteTransformFeedbacks( 1, &TransformFeedback );
+   if (VolumeBuffer != 0) glDeleteBuffers( 1, &VolumeBuffer );
+   if (VAO != 0) glDeleteVertexArrays( 1, &VAO );
+   if (OverflowQuery != 0) glDeleteQueries( 1, &OverflowQuery );
+   if (!InstanceQueries.empty()) glDeleteQueries( static_cast<GLsizei>(InstanceQueries.size()), InstanceQueries.data() );
+   TransformFeedback = 0;
+   VolumeBuffer = 0;
+   VAO = 0;
+   OverflowQuery = 0;
+   InstanceQueries.clear();
+   InstanceFirsts.clear();
+   InstanceCounts.clear();
+   IsValid = false;
+   StableLookUpNum = 0;
+   StateCacheGL::getInstance().invalidate();
+}
+
+void ShadowVolumeCacheGL::prepareVolumeBuffer()
+{
+   if (VolumeBuffer != 0) glDeleteBuffers( 1, &VolumeBuffer );
+
+   glCreateBuffers( 1, &VolumeBuffer );
+   glNamedBufferStorage( VolumeBuffer, TriangleCapacity * 3 * sizeof( glm::vec4 ), nullptr, 0 );
+   glTransformFeedbackBufferBase( TransformFeedback, 0, VolumeBuffer );
+   glVertexArrayVertexBuffer( VAO, 0, VolumeBuffer, 0, sizeof( glm::vec4 ) );
+}
+
+void ShadowVolumeCacheGL::initialize(GLsizeiptr triangle_capacity)
+{
+   release();
+
+   TriangleCapacity = std::max( triangle_capacity, static_cast<GLsizeiptr>(1) );
+   glCreateTransformFeedbacks( 1, &TransformFeedback );
+   glCreateQueries( GL_TRANSFORM_FEEDBACK_OVERFLOW, 1, &OverflowQuery );
+   glCreateVertexArrays( 1, &VAO );
+   glVertexArrayAttribFormat( VAO, 0, 4, GL_FLOAT, GL_FALSE, 0 );
+   glEnableVertexArrayAttrib( VAO, 0 );
+   glVertexArrayAttribBinding( VAO, 0, 0 );
+   prepareVolumeBuffer();
+}
+
+bool ShadowVolumeCacheGL::lookUp(const Key& key)
+{
+   const bool hit = IsValid && CachedKey == key;
+   RecentHits <<= 1;
+   RecentHits[0] = hit;
+   RecentLookUpNum = std::min( RecentLookUpNum + 1, RecentLookUpCapacity );
+   if (hit) return true;
+
+   if (StableLookUpNum > 0 && MissedKey == key) StableLookUpNum++;
+   else {
+      MissedKey = key;
+      StableLookUpNum = 1;
+   }
+   return false;
+}
+
+void ShadowVolumeCacheGL::beginCapture(int instance_num)
+{
+   if (static_cast<int>(InstanceQueries.size()) < instance_num) {
+      const auto size = InstanceQueries.size();
+      InstanceQueries.resize( instance_num );
+      glCreateQueries(
+         GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, static_cast<GLsizei>(instance_num - size), InstanceQueries.data() + size
+      );
+   }
+   InstanceFirsts.resize( instance_num );
+   InstanceCounts.resize( instance_num );
+
+   StateCacheGL::getInstance().enable( GL_RASTERIZER_DISCARD );
+   glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, TransformFeedback );
+   glBeginQuery( GL_TRANSFORM_FEEDBACK_OVERFLOW, OverflowQuery );
+   glBeginTransformFeedback( GL_TRIANGLES );
+}
+
+void ShadowVolumeCacheGL::beginInstance(int instance) const
+{
+   glBeginQuery( GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, InstanceQueries[instance] );
+}
+
+void ShadowVolumeCacheGL::endInstance() const
+{
+   glEndQuery( GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN );
+}
+
+bool ShadowVolumeCacheGL::endCapture(const Key& key)
+{
+   glEndTransformFeedback();
+   glEndQuery( GL_TRANSFORM_FEEDBACK_OVERFLOW );
+   glBindTransformFeedback( GL_TRANSFORM_FEEDBACK, 0 );
+   StateCacheGL::getInstance().disable( GL_RASTERIZER_DISCARD );
+
+   // This waits for the capture, but it only happens when the key has changed.
+   GLuint overflowed = 0;
+   glGetQueryObjectuiv( OverflowQuery, GL_QUERY_RESULT, &overflowed );
+   if (overflowed != 0) {
+      TriangleCapacity *= 2;
+      prepareVolumeBuffer();
+      IsValid = false;
+      return false;
+   }
+
+   // The instances are captured one after another, so their ranges follow from the primitives each one wrote.
+   GLint first = 0;
+   for (size_t i = 0; i < InstanceCounts.size(); ++i) {
+      GLuint primitive_num = 0;
+      glGetQueryObjectuiv( InstanceQueries[i], GL_QUERY_RESULT, &primitive_num );
+      InstanceFirsts[i] = first;
+      InstanceCounts[i] = static_cast<GLsizei>(primitive_num * 3);
+      first += InstanceCounts[i];
+   }
+
+   CachedKey = key;
+   IsValid = true;
+   StableLookUpNum = 0;
+   return true;
+}
+
+void ShadowVolumeCacheGL::draw(const std::vector<int>& instances) const
+{
+   // The ranges of consecutive instances are adjacent, so they are merged into one.
+   std::vector<GLint> firsts;
+   std::vector<GLsizei> counts;
+   for (const int instance : instances) {
+      if (!counts.empty() && firsts.back() + counts.back() == InstanceFirsts[instance]) {
+         counts.back() += InstanceCounts[instance];
+      }
+      else {
+         firsts.emplace_back( InstanceFirsts[instance] );
+         counts.emplace_back( InstanceCounts[instance] );
+      }
+   }
+   if (firsts.empty()) return;
+
+   StateCacheGL::getInstance().bindVertexArray( VAO );
+   glMultiDrawArrays( GL_TRIANGLES, firsts.data(), counts.data(), static_cast<GLsizei>(firsts.size()) );
+}
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "shadow_volume_generator.h"
+
+#ifdef USE_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+ShadowVolumeGenerator::ShadowVolumeGenerator() :
+   UseAVX2( isAVX2Supported() ), TriangleNum( 0 ), PlaneNum( 0 ), CoreNum( 1 ), ElapsedSeconds( 0.0 )
+{
+}
+
+bool ShadowVolumeGenerator::isAVX2Supported()
+{
+#if defined(USE_AVX2) && defined(_MSC_VER)
+   std::array<int, 4> info{};
+   __cpuid( info.data(), 1 );
+   const bool fma = (info[2] & (1 << 12)) != 0;
+   const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv( 0 ) & 6) == 6;
+   __cpuidex( info.data(), 7, 0 );
+   return fma && os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#elif defined(USE_AVX2)
+   return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+#else
+   return false;
+#endif
+}
+
+void ShadowVolumeGenerator::setMesh(
+   const std::vector<glm::vec3>& positions,
+   const std::vector<GLuint>& adjacency_indices,
+   ThreadPool& pool
+)
+{
+   Positions = positions;
+   Indices = adjacency_indices;
+   TriangleNum = (Indices.empty() ? Positions.size() : Indices.size()) / 6;
+   PlaneNum = (TriangleNum + 7) & ~static_cast<size_t>(7);
+
+   // The padding planes are zero, so they are never facing the light and never used.
+   PlaneX.assign( PlaneNum * 4, 0.0f );
+   PlaneY.assign( PlaneNum * 4, 0.0f );
+   PlaneZ.assign( PlaneNum * 4, 0.0f );
+   PlaneDMin.assign( PlaneNum * 4, 0.0f );
+   PlaneDMax.assign( PlaneNum * 4, 0.0f );
+   FacingBits.assign( PlaneNum * 4 / 8, 0 );
+
+   const int task_num = getTaskNum( TriangleNum, pool );
+   pool.run(
+      task_num, [&](int t) {
+         const size_t end = TriangleNum * (t + 1) / task_num;
+         for (size_t i = TriangleNum * t / task_num; i < end; ++i) {
+            // (v0, v1, v2) is the triangle itself, and (e0, adjacent vertex, e1) is the triangle across each edge.
+            const std::array<std::array<int, 3>, 4> corners = {
+               std::array<int, 3>{ 0, 2, 4 },
+               std::array<int, 3>{ 0, 1, 2 },
+               std::array<int, 3>{ 2, 3, 4 },
+               std::array<int, 3>{ 4, 5, 0 }
+            };
+            for (int set = 0; set < 4; ++set) {
+               const glm::vec3& p0 = getPosition( i, corners[set][0] );
+               const glm::vec3& p1 = getPosition( i, corners[set][1] );
+               const glm::vec3& p2 = getPosition( i, corners[set][2] );
+               const glm::vec3 normal = glm::cross( p1 - p0, p2 - p0 );
+               const size_t plane = set * PlaneNum + i;
+               PlaneX[plane] = normal.x;
+               PlaneY[plane] = normal.y;
+               PlaneZ[plane] = normal.z;
+               const glm::vec3 d(glm::dot( normal, p0 ), glm::dot( normal, p1 ), glm::dot( normal, p2 ));
+               PlaneDMin[plane] = glm::compMin( d );
+               PlaneDMax[plane] = glm::compMax( d );
+            }
+         }
+      }
+   );
+}
+
+void ShadowVolumeGenerator::classifyPlanes(size_t begin, size_t end, const glm::vec4& light_position, float threshold)
+{
+   // Like the geometry shader, a plane faces the light when dot( n, L.xyz - L.w * p ) is not below the threshold
+   // for any of its three vertices p. With d = dot( n, p ), that is the smallest d if L.w is positive.
+   // begin and end are multiples of 8, so every byte of the bits is written by one task.
+   const std::vector<float>& plane_d = light_position.w >= 0.0f ? PlaneDMin : PlaneDMax;
+#ifdef USE_AVX2
+   if (UseAVX2) {
+      classifyPlanesAVX2( begin, end, plane_d, light_position, threshold );
+      return;
+   }
+#endif
+   for (size_t i = begin; i < end; i += 8) {
+      uint8_t bits = 0;
+      for (size_t k = 0; k < 8; ++k) {
+         const float value =
+            PlaneX[i + k] * light_position.x + PlaneY[i + k] * light_position.y + PlaneZ[i + k] * light_position.z -
+            light_position.w * plane_d[i + k];
+         if (value >= threshold) bits |= static_cast<uint8_t>(1u << k);
+      }
+      FacingBits[i >> 3] = bits;
+   }
+}
+
+#ifdef USE_AVX2
+AVX2_TARGET void ShadowVolumeGenerator::classifyPlanesAVX2(
+   size_t begin,
+   size_t end,
+   const std::vector<float>& plane_d,
+   const glm::vec4& light_position,
+   float threshold
+)
+{
+   const __m256 lx = _mm256_set1_ps( light_position.x );
+   const __m256 ly = _mm256_set1_ps( light_position.y );
+   const __m256 lz = _mm256_set1_ps( light_position.z );
+   const __m256 lw = _mm256_set1_ps( -light_position.w );
+   const __m256 t = _mm256_set1_ps( threshold );
+   for (size_t i = begin; i < end; i += 8) {
+      __m256 value = _mm256_mul_ps( _mm256_loadu_ps( &plane_d[i] ), lw );
+      value = _mm256_fmadd_ps( _mm256_loadu_ps( &PlaneX[i] ), lx, value );
+      value = _mm256_fmadd_ps( _mm256_loadu_ps( &PlaneY[i] ), ly, value );
+      value = _mm256_fmadd_ps( _mm256_loadu_ps( &PlaneZ[i] ), lz, value );
+      FacingBits[i >> 3] = static_cast<uint8_t>(_mm256_movemask_ps( _mm256_cmp_ps( value, t, _CMP_GE_OQ ) ));
+   }
+}
+#endif
+
+int ShadowVolumeGenerator::getVertexNum(size_t triangle, bool is_z_fail_algorithm, bool is_finite, bool robust) const
+{
+   const bool faces_light = isFacing( 0, triangle );
+   if (!faces_light && !robust) return 0;
+
+   // The Z-pass algorithm needs only the far cap, and only when the volume is bounded.
+   int vertex_num = is_z_fail_algorithm ? 6 : is_finite ? 3 : 0;
+   for (int j = 0; j < 3; ++j) {
+      if (faces_light != isFacing( j + 1, triangle )) vertex_num += 6;
+   }
+   return vertex_num;
+}
+
+void ShadowVolumeGenerator::writeVolume(
+   glm::vec4* output,
+   size_t triangle,
+   const glm::vec4& light_position,
+   float offset,
+   float extrusion_radius,
+   bool is_z_fail_algorithm,
+   bool robust
+) const
+{
+   const bool faces_light = isFacing( 0, triangle );
+   if (!faces_light && !robust) return;
+
+   const bool is_finite = extrusion_radius > 0.0f && light_position.w != 0.0f;
+   const glm::vec3 light = is_finite ? glm::vec3(light_position) / light_position.w : glm::vec3(0.0f);
+   std::array<glm::vec4, 3> near_vertices{}, far_vertices{};
+   for (int k = 0; k < 3; ++k) {
+      const glm::vec3& p = getPosition( triangle, k * 2 );
+      const glm::vec3 light_direction = -glm::normalize( glm::vec3(light_position) - light_position.w * p );
+      near_vertices[k] = glm::vec4(p + light_direction * offset, 1.0f);
+      // The far vertex is never nearer than the near vertex, so that the volume never turns inside out.
+      far_vertices[k] = is_finite ?
+         glm::vec4(light + light_direction * std::max( extrusion_radius, glm::distance( light, p ) + offset ), 1.0f) :
+         glm::vec4(light_direction, 0.0f);
+   }
+
+   // These follow the vertex orders of shadow_volume.geom, with each strip split into two triangles.
+   int n = 0;
+   if (is_z_fail_algorithm) {
+      const std::array<int, 3> near_order = faces_light ? std::array<int, 3>{ 0, 1, 2 } : std::array<int, 3>{ 0, 2, 1 };
+      for (const auto& k : near_order) output[n++] = near_vertices[k];
+   }
+   if (is_z_fail_algorithm || is_finite) {
+      const std::array<int, 3> far_order = faces_light ? std::array<int, 3>{ 0, 2, 1 } : std::array<int, 3>{ 0, 1, 2 };
+      for (const auto& k : far_order) output[n++] = far_vertices[k];
+   }
+   for (int j = 0; j < 3; ++j) {
+      if (faces_light == isFacing( j + 1, triangle )) continue;
+
+      const int first = faces_light ? j : (j + 1) % 3;
+      const int second = faces_light ? (j + 1) % 3 : j;
+      const std::array<glm::vec4, 4> strip = {
+         near_vertices[first], far_vertices[first], near_vertices[second], far_vertices[second]
+      };
+      output[n++] = strip[0];
+      output[n++] = strip[1];
+      output[n++] = strip[2];
+      output[n++] = strip[2];
+      output[n++] = strip[1];
+      output[n++] = strip[3];
+   }
+}
+
+void ShadowVolumeGenerator::generate(
+   const glm::vec4& light_position,
+   float eye_scale,
+   float extrusion_radius,
+   bool is_z_fail_algorithm,
+   bool robust,
+   ThreadPool& pool
+)
+{
+   const auto start = std::chrono::steady_clock::now();
+
+   // The shader tests unnormalized normals in the eye space, where a dot product is eye_scale^3 times larger.
+   const float threshold = Epsilon / (eye_scale * eye_scale * eye_scale);
+   const float offset = Epsilon / eye_scale;
+   const bool is_finite = extrusion_radius > 0.0f && light_position.w != 0.0f;
+
+   const int task_num = getTaskNum( TriangleNum, pool );
+   std::vector<size_t> offsets(task_num + 1, 0);
+   const auto getTaskBegin = [&](int t) {
+      return (TriangleNum * t / task_num) & ~static_cast<size_t>(7);
+   };
+   pool.run(
+      task_num, [&](int t) {
+         const size_t begin = getTaskBegin( t );
+         const size_t end = t + 1 == task_num ? PlaneNum : getTaskBegin( t + 1 );
+         for (int set = 0; set < 4; ++set) {
+            classifyPlanes( set * PlaneNum + begin, set * PlaneNum + end, light_position, threshold );
+         }
+      }
+   );
+   pool.run(
+      task_num, [&](int t) {
+         const size_t end = t + 1 == task_num ? TriangleNum : getTaskBegin( t + 1 );
+         size_t vertex_num = 0;
+         for (size_t i = getTaskBegin( t ); i < end; ++i) {
+            vertex_num += getVertexNum( i, is_z_fail_algorithm, is_finite, robust );
+         }
+         offsets[t + 1] = vertex_num;
+      }
+   );
+   for (int t = 0; t < task_num; ++t) offsets[t + 1] += offsets[t];
+
+   VolumeVertices.resize( offsets[task_num] );
+   pool.run(
+      task_num, [&](int t) {
+         const size_t end = t + 1 == task_num ? TriangleNum : getTaskBegin( t + 1 );
+         glm::vec4* output = VolumeVertices.data() + offsets[t];
+         for (size_t i = getTaskBegin( t ); i < end; ++i) {
+            writeVolume( output, i, light_position, offset, extrusion_radius, is_z_fail_algorithm, robust );
+            output += getVertexNum( i, is_z_fail_algorithm, is_finite, robust );
+         }
+      }
+   );
+
+   const auto end = std::chrono::steady_clock::now();
+   ElapsedSeconds = std::chrono::duration<double>(end - start).count();
+   CoreNum = task_num;
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "state_cache.h"
+
+StateCacheGL::StateCacheGL() :
+   IssuedCallNum( 0 ), DroppedCallNum( 0 ), LastIssuedCallNum( 0 ), LastDroppedCallNum( 0 )
+{
+}
+
+void StateCacheGL::invalidate()
+{
+   Capabilities.clear();
+   DrawBuffers.clear();
+   UniformBuffers.clear();
+   DepthMask.reset();
+   DepthFunc.reset();
+   StencilFunc.reset();
+   for (auto& operation : StencilOperations) operation.reset();
+   BlendFunc.reset();
+   Program.reset();
+   VertexArray.reset();
+   DrawIndirectBuffer.reset();
+   Framebuffer.reset();
+   Viewport.reset();
+   Scissor.reset();
+}
+
+void StateCacheGL::beginFrame()
+{
+   LastIssuedCallNum = IssuedCallNum;
+   LastDroppedCallNum = DroppedCallNum;
+   IssuedCallNum = 0;
+   DroppedCallNum = 0;
+}
+
+void StateCacheGL::setCapability(GLenum capability, bool enabled)
+{
+   const auto it = Capabilities.find( capability );
+   if (it != Capabilities.end() && it->second == enabled) {
+      DroppedCallNum++;
+      return;
+   }
+   Capabilities[capability] = enabled;
+   IssuedCallNum++;
+   if (enabled) glEnable( capability );
+   else glDisable( capability );
+}
+
+void StateCacheGL::depthMask(GLboolean flag)
+{
+   if (update( DepthMask, flag )) glDepthMask( flag );
+}
+
+void StateCacheGL::depthFunc(GLenum func)
+{
+   if (update( DepthFunc, func )) glDepthFunc( func );
+}
+
+void StateCacheGL::stencilFunc(GLenum func, GLint reference, GLuint mask)
+{
+   if (update( StencilFunc, std::make_tuple( func, reference, mask ) )) glStencilFunc( func, reference, mask );
+}
+
+void StateCacheGL::stencilOpSeparate(GLenum face, GLenum stencil_fail, GLenum depth_fail, GLenum depth_pass)
+{
+   const StencilOperation operation{ stencil_fail, depth_fail, depth_pass };
+   const bool front = face == GL_FRONT || face == GL_FRONT_AND_BACK;
+   const bool back = face == GL_BACK || face == GL_FRONT_AND_BACK;
+   const bool changed_front = front && !(StencilOperations[0].has_value() && StencilOperations[0].value() == operation);
+   const bool changed_back = back && !(StencilOperations[1].has_value() && StencilOperations[1].value() == operation);
+   if (!changed_front && !changed_back) {
+      DroppedCallNum++;
+      return;
+   }
+   if (front) StencilOperations[0] = operation;
+   if (back) StencilOperations[1] = operation;
+   IssuedCallNum++;
+   glStencilOpSeparate( face, stencil_fail, depth_fail, depth_pass );
+}
+
+void StateCacheGL::blendFunc(GLenum source_factor, GLenum destination_factor)
+{
+   if (update( BlendFunc, std::make_pair( source_factor, destination_factor ) )) {
+      glBlendFunc( source_factor, destination_factor );
+   }
+}
+
+void StateCacheGL::useProgram(GLuint program)
+{
+   if (update( Program, program )) glUseProgram( program );
+}
+
+void StateCacheGL::bindVertexArray(GLuint vertex_array)
+{
+   if (update( VertexArray, vertex_array )) glBindVertexArray( vertex_array );
+}
+
+void StateCacheGL::bindDrawIndirectBuffer(GLuint buffer)
+{
+   if (update( DrawIndirectBuffer, buffer )) glBindBuffer( GL_DRAW_INDIRECT_BUFFER, buffer );
+}
+
+void StateCacheGL::bindUniformBufferRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+   const auto range = std::make_tuple( buffer, offset, size );
+   const auto it = UniformBuffers.find( binding );
+   if (it != UniformBuffers.end() && it->second == range) {
+      DroppedCallNum++;
+      return;
+   }
+   UniformBuffers[binding] = range;
+   IssuedCallNum++;
+   if (size == 0) glBindBufferBase( GL_UNIFORM_BUFFER, binding, buffer );
+   else glBindBufferRange( GL_UNIFORM_BUFFER, binding, buffer, offset, size );
+}
+
+void StateCacheGL::bindFramebuffer(GLuint framebuffer)
+{
+   if (update( Framebuffer, framebuffer )) glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+}
+
+void StateCacheGL::drawBuffer(GLenum buffer)
+{
+   // Without a known framebuffer, the owner of the draw buffer is unknown as well.
+   if (!Framebuffer.has_value()) {
+      IssuedCallNum++;
+      glDrawBuffer( buffer );
+      return;
+   }
+
+   const auto it = DrawBuffers.find( Framebuffer.value() );
+   if (it != DrawBuffers.end() && it->second == buffer) {
+      DroppedCallNum++;
+      return;
+   }
+   DrawBuffers[Framebuffer.value()] = buffer;
+   IssuedCallNum++;
+   glDrawBuffer( buffer );
+}
+
+void StateCacheGL::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+   if (update( Viewport, glm::ivec4(x, y, width, height) )) glViewport( x, y, width, height );
+}
+
+void StateCacheGL::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+   if (update( Scissor, glm::ivec4(x, y, width, height) )) glScissor( x, y, width, height );
+}
\ No newline at end of file
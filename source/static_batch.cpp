@@ -0,0 +1,133 @@
+#include "static_batch.h"
+
+StaticBatchGL::StaticBatchGL() :
+   VAO( 0 ), PositionVAO( 0 ), VBO( 0 ), IBO( 0 ), CommandBuffer( 0 ), DrawDataBuffer( 0 )
+{
+}
+
+StaticBatchGL::~StaticBatchGL()
+{
+   release();
+}
+
+void StaticBatchGL::release()
+{
+   if (VAO != 0) glDeleteVertexArrays( 1, &VAO );
+   if (PositionVAO != 0) glDeleteVertexArrays( 1, &PositionVAO );
+   if (VBO != 0) glDeleteBuffers( 1, &VBO );
+   if (IBO != 0) glDeleteBuffers( 1, &IBO );
+   if (CommandBuffer != 0) glDeleteBuffers( 1, &CommandBuffer );
+   if (DrawDataBuffer != 0) glDeleteBuffers( 1, &DrawDataBuffer );
+   VAO = 0;
+   PositionVAO = 0;
+   VBO = 0;
+   IBO = 0;
+   CommandBuffer = 0;
+   DrawDataBuffer = 0;
+}
+
+int StaticBatchGL::addMesh(
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<glm::vec3>& normals,
+   const std::vector<GLuint>& indices
+)
+{
+   assert( vertices.size() == normals.size() );
+
+   MeshRange mesh{};
+   mesh.IndexNum = static_cast<GLuint>(indices.size());
+   mesh.FirstIndex = static_cast<GLuint>(IndexBuffer.size());
+   mesh.BaseVertex = static_cast<GLint>(DataBuffer.size() / 6);
+   for (size_t i = 0; i < vertices.size(); ++i) {
+      DataBuffer.push_back( vertices[i].x );
+      DataBuffer.push_back( vertices[i].y );
+      DataBuffer.push_back( vertices[i].z );
+      DataBuffer.push_back( normals[i].x );
+      DataBuffer.push_back( normals[i].y );
+      DataBuffer.push_back( normals[i].z );
+   }
+   IndexBuffer.insert( IndexBuffer.end(), indices.begin(), indices.end() );
+   Meshes.emplace_back( mesh );
+   return static_cast<int>(Meshes.size()) - 1;
+}
+
+void StaticBatchGL::addDraw(int mesh_index, const glm::mat4& to_world, const Material& material)
+{
+   const MeshRange& mesh = Meshes[mesh_index];
+   const auto draw_index = static_cast<GLuint>(Commands.size());
+   Commands.push_back( { mesh.IndexNum, 1, mesh.FirstIndex, mesh.BaseVertex, draw_index } );
+
+   DrawData data{};
+   data.WorldMatrix = to_world;
+   data.EmissionColor = material.EmissionColor;
+   data.AmbientColor = material.AmbientReflectionColor;
+   data.DiffuseColor = material.DiffuseReflectionColor;
+   data.SpecularColor = material.SpecularReflectionColor;
+   data.SpecularExponent = material.SpecularReflectionExponent;
+   Draws.emplace_back( data );
+}
+
+void StaticBatchGL::build()
+{
+   release();
+   if (Commands.empty()) return;
+
+   glCreateBuffers( 1, &VBO );
+   glNamedBufferStorage( VBO, static_cast<GLsizeiptr>(sizeof( GLfloat ) * DataBuffer.size()), DataBuffer.data(), 0 );
+   glCreateBuffers( 1, &IBO );
+   glNamedBufferStorage( IBO, static_cast<GLsizeiptr>(sizeof( GLuint ) * IndexBuffer.size()), IndexBuffer.data(), 0 );
+
+   constexpr GLsizei stride = 6 * sizeof( GLfloat );
+   glCreateVertexArrays( 1, &VAO );
+   glVertexArrayVertexBuffer( VAO, 0, VBO, 0, stride );
+   glVertexArrayAttribFormat( VAO, ObjectGL::VertexLoc, 3, GL_FLOAT, GL_FALSE, 0 );
+   glEnableVertexArrayAttrib( VAO, ObjectGL::VertexLoc );
+   glVertexArrayAttribBinding( VAO, ObjectGL::VertexLoc, 0 );
+   glVertexArrayAttribFormat( VAO, ObjectGL::NormalLoc, 3, GL_FLOAT, GL_FALSE, 3 * sizeof( GLfloat ) );
+   glEnableVertexArrayAttrib( VAO, ObjectGL::NormalLoc );
+   glVertexArrayAttribBinding( VAO, ObjectGL::NormalLoc, 0 );
+   glVertexArrayElementBuffer( VAO, IBO );
+
+   // The depth-only pass does not fetch the normals.
+   glCreateVertexArrays( 1, &PositionVAO );
+   glVertexArrayVertexBuffer( PositionVAO, 0, VBO, 0, stride );
+   glVertexArrayAttribFormat( PositionVAO, ObjectGL::VertexLoc, 3, GL_FLOAT, GL_FALSE, 0 );
+   glEnableVertexArrayAttrib( PositionVAO, ObjectGL::VertexLoc );
+   glVertexArrayAttribBinding( PositionVAO, ObjectGL::VertexLoc, 0 );
+   glVertexArrayElementBuffer( PositionVAO, IBO );
+
+   glCreateBuffers( 1, &CommandBuffer );
+   glNamedBufferStorage(
+      CommandBuffer,
+      static_cast<GLsizeiptr>(sizeof( DrawElementsIndirectCommand ) * Commands.size()),
+      Commands.data(),
+      0
+   );
+   glCreateBuffers( 1, &DrawDataBuffer );
+   glNamedBufferStorage(
+      DrawDataBuffer,
+      static_cast<GLsizeiptr>(sizeof( DrawData ) * Draws.size()),
+      Draws.data(),
+      0
+   );
+}
+
+void StaticBatchGL::transferUniformsToShader(const ShaderGL* shader) const
+{
+   const glm::mat4 identity(1.0f);
+   glUniformMatrix4fv( shader->getDequantizationLocation(), 1, GL_FALSE, &identity[0][0] );
+   glUniform1i( shader->getCompactVertexLocation(), 0 );
+   glUniform1i( shader->getInstancingLocation(), 0 );
+   glUniform1i( shader->getDrawDataLocation(), 1 );
+}
+
+void StaticBatchGL::draw(bool position_only) const
+{
+   if (Commands.empty()) return;
+
+   StateCacheGL& state = StateCacheGL::getInstance();
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, DrawDataBinding, DrawDataBuffer );
+   state.bindDrawIndirectBuffer( CommandBuffer );
+   state.bindVertexArray( position_only ? PositionVAO : VAO );
+   glMultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(Commands.size()), 0 );
+}
\ No newline at end of file
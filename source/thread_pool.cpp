@@ -0,0 +1,82 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int thread_num) :
+   Stop( false ), TaskNum( 0 ), NextTask( 0 ), RemainingTasks( 0 ), Generation( 0 ), Task( nullptr )
+{
+   if (thread_num <= 0) thread_num = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+
+   // The thread calling run() is the last worker.
+   Workers.reserve( thread_num - 1 );
+   for (int i = 1; i < thread_num; ++i) Workers.emplace_back( &ThreadPool::work, this );
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> lock( Mutex );
+      Stop = true;
+   }
+   WakeUp.notify_all();
+   for (auto& worker : Workers) worker.join();
+}
+
+void ThreadPool::executeTasks(uint64_t generation)
+{
+   while (true) {
+      int index;
+      const std::function<void(int)>* task;
+      {
+         std::lock_guard<std::mutex> lock( Mutex );
+         if (generation != Generation || NextTask >= TaskNum) return;
+         index = NextTask++;
+         task = Task;
+      }
+
+      (*task)( index );
+
+      std::lock_guard<std::mutex> lock( Mutex );
+      if (--RemainingTasks == 0) Done.notify_all();
+   }
+}
+
+void ThreadPool::work()
+{
+   uint64_t generation = 0;
+   while (true) {
+      {
+         std::unique_lock<std::mutex> lock( Mutex );
+         WakeUp.wait( lock, [this, generation] { return Stop || Generation != generation; } );
+         if (Stop) return;
+         generation = Generation;
+      }
+      executeTasks( generation );
+   }
+}
+
+void ThreadPool::run(int task_num, const std::function<void(int)>& task)
+{
+   if (task_num <= 0) return;
+   if (Workers.empty() || task_num == 1) {
+      for (int i = 0; i < task_num; ++i) task( i );
+      return;
+   }
+
+   std::lock_guard<std::mutex> run_lock( RunMutex );
+   uint64_t generation;
+   {
+      std::lock_guard<std::mutex> lock( Mutex );
+      Task = &task;
+      TaskNum = task_num;
+      NextTask = 0;
+      RemainingTasks = task_num;
+      generation = ++Generation;
+   }
+   WakeUp.notify_all();
+
+   executeTasks( generation );
+
+   std::unique_lock<std::mutex> lock( Mutex );
+   Done.wait( lock, [this] { return RemainingTasks == 0; } );
+   Task = nullptr;
+   TaskNum = 0;
+}
\ No newline at end of file
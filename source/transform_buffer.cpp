@@ -0,0 +1,91 @@
+#include "transform_buffer.h"
+
+TransformBufferGL::TransformBufferGL() :
+   Region( 0 ), SlotIndex( 0 ), LastWrittenSlotNum( 0 ), Buffer( 0 ), SlotSize( 0 ), MappedBuffer( nullptr ),
+   Fences{}, LastWorldMatrix( 1.0f ), LastViewProjectionMatrix( 1.0f )
+{
+}
+
+void TransformBufferGL::initialize()
+{
+   GLint alignment = 0;
+   glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+   alignment = std::max( alignment, 1 );
+   SlotSize = (static_cast<GLintptr>(sizeof( Transform )) + alignment - 1) / alignment * alignment;
+
+   const auto size = static_cast<GLsizeiptr>(SlotSize * SlotNumPerRegion * RegionNum);
+   constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+   glCreateBuffers( 1, &Buffer );
+   glNamedBufferStorage( Buffer, size, nullptr, flags );
+   MappedBuffer = static_cast<uint8_t*>(glMapNamedBufferRange( Buffer, 0, size, flags ));
+   Region = 0;
+   SlotIndex = 0;
+   LastOffset.reset();
+}
+
+void TransformBufferGL::release()
+{
+   for (auto& fence : Fences) {
+      if (fence != nullptr) {
+         glDeleteSync( fence );
+         fence = nullptr;
+      }
+   }
+   if (Buffer != 0) {
+      glUnmapNamedBuffer( Buffer );
+      glDeleteBuffers( 1, &Buffer );
+      Buffer = 0;
+   }
+   MappedBuffer = nullptr;
+   LastOffset.reset();
+}
+
+void TransformBufferGL::beginFrame()
+{
+   if (Buffer == 0) return;
+
+   LastWrittenSlotNum = SlotIndex;
+   Region = (Region + 1) % RegionNum;
+   GLsync& fence = Fences[Region];
+   if (fence != nullptr) {
+      while (glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000 ) == GL_TIMEOUT_EXPIRED) {}
+      glDeleteSync( fence );
+      fence = nullptr;
+   }
+   SlotIndex = 0;
+   // The last slot belongs to the previous region, which is fenced before any draw of this frame.
+   LastOffset.reset();
+}
+
+void TransformBufferGL::endFrame()
+{
+   if (Buffer == 0) return;
+
+   Fences[Region] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+void TransformBufferGL::bind(GLuint binding, const glm::mat4& to_world, const CameraGL* camera)
+{
+   if (Buffer == 0) initialize();
+
+   const glm::mat4& view_projection = camera->getViewProjectionMatrix();
+   if (!LastOffset.has_value() || LastWorldMatrix != to_world || LastViewProjectionMatrix != view_projection) {
+      if (SlotIndex == SlotNumPerRegion) {
+         // The region is full, so the slots of this frame are reused after the GPU has finished them.
+         glFinish();
+         SlotIndex = 0;
+      }
+      const GLintptr offset = (static_cast<GLintptr>(Region) * SlotNumPerRegion + SlotIndex) * SlotSize;
+      auto* transform = reinterpret_cast<Transform*>(MappedBuffer + offset);
+      transform->WorldMatrix = to_world;
+      transform->ModelViewProjectionMatrix = view_projection * to_world;
+      SlotIndex++;
+
+      LastOffset = offset;
+      LastWorldMatrix = to_world;
+      LastViewProjectionMatrix = view_projection;
+   }
+   StateCacheGL::getInstance().bindUniformBufferRange(
+      binding, Buffer, LastOffset.value(), static_cast<GLsizeiptr>(sizeof( Transform ))
+   );
+}
\ No newline at end of file